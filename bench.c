@@ -0,0 +1,238 @@
+// Benchmark of the shell's own overhead. hw2 is driven through a pseudo terminal like a user
+// would, with the test programs add, counter and hello as jobs, alone or behind sleep in a pipeline:
+//	gcc -O2 -o hw2 hw2.c
+//	gcc -O2 -o bench bench.c -lutil
+//	./bench [-n iterations] [-b burst] [-z zygotes] [-t think] [-o results] [shell]
+// -z runs the shell with a pool of that many zygotes to launch the jobs, -t waits think ms at
+// the prompt before each command like a user would, while the shell is idle.
+// Rebuild hw2 first, the tracked binary predates pipelines and the other features measured.
+// Results are printed and written as JSON to bench_output.txt (or -o) to compare runs
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/wait.h>
+
+#define OUTPUT_BUFFER (1 << 20)
+#define TIMEOUT 10.0 // seconds to wait for the expected output
+
+int ptyfd = -1;
+int shellpid = -1;
+char output[OUTPUT_BUFFER];
+size_t outlen = 0, outpos = 0; // outpos: start of the output not matched yet
+
+double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void fail(const char *what){
+	fprintf(stderr, "bench: %s, last output: %.*s\n", what, (int)(outlen - outpos), output + outpos);
+	if(shellpid != -1) kill(shellpid, SIGKILL);
+	exit(EXIT_FAILURE);
+}
+
+// drop the output matched so far
+void consume(){
+	outlen -= outpos;
+	memmove(output, output + outpos, outlen);
+	outpos = 0;
+}
+
+void type(const char *s){
+	if(write(ptyfd, s, strlen(s)) != (ssize_t)strlen(s)) fail("write to the pty failed");
+}
+
+/* Read the shell's output until it contains s, return the time it was seen */
+double expect(const char *s){
+	double deadline = now() + TIMEOUT;
+	while(1){
+		char *found = memmem(output + outpos, outlen - outpos, s, strlen(s));
+		if(found){
+			outpos = found - output + strlen(s);
+			return now();
+		}
+		// keep the unmatched part only
+		if(outlen == OUTPUT_BUFFER){
+			memmove(output, output + outpos, outlen - outpos);
+			outlen -= outpos;
+			outpos = 0;
+		}
+		struct pollfd p = { ptyfd, POLLIN, 0 };
+		int timeout = (deadline - now()) * 1000;
+		if(timeout <= 0 || poll(&p, 1, timeout) <= 0) fail("timed out");
+		ssize_t n = read(ptyfd, output + outlen, OUTPUT_BUFFER - outlen);
+		if(n <= 0) fail("the shell exited");
+		outlen += n;
+	}
+}
+
+// samples of one measurement, in microseconds
+struct series{
+	const char *name;
+	double *us;
+	int n;
+};
+
+int compare(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+void add(struct series *s, double seconds){
+	s->us[s->n++] = seconds * 1e6;
+}
+
+void report(FILE *f, struct series *s, int last){
+	qsort(s->us, s->n, sizeof *s->us, compare);
+	double sum = 0;
+	for(int i = 0; i < s->n; i++) sum += s->us[i];
+	printf("%-22s n %4i  min %9.1f  median %9.1f  p90 %9.1f  max %9.1f  mean %9.1f us\n", s->name, s->n,
+		s->us[0], s->us[s->n / 2], s->us[s->n * 9 / 10], s->us[s->n - 1], sum / s->n);
+	fprintf(f, "  \"%s\": {\"unit\": \"us\", \"n\": %i, \"min\": %.1f, \"median\": %.1f, \"p90\": %.1f, \"max\": %.1f, \"mean\": %.1f}%s\n",
+		s->name, s->n, s->us[0], s->us[s->n / 2], s->us[s->n * 9 / 10], s->us[s->n - 1], sum / s->n, last ? "" : ",");
+}
+
+/* Return the peak resident set size of process pid in KB, -1 if unknown */
+long peakRSS(int pid){
+	char path[64], line[256];
+	long kb = -1;
+	snprintf(path, sizeof path, "/proc/%i/status", pid);
+	FILE *f = fopen(path, "r");
+	if(!f) return -1;
+	while(fgets(line, sizeof line, f)) sscanf(line, "VmHWM: %ld", &kb);
+	fclose(f);
+	return kb;
+}
+
+int main(int argc, char **argv){
+	int iterations = 200, burst = 100, zygotes = 0, think = 0;
+	const char *shell = "./hw2", *results = "bench_output.txt";
+	int opt;
+	while((opt = getopt(argc, argv, "n:b:z:t:o:")) != -1){
+		switch(opt){
+			case 'n': iterations = atoi(optarg); break;
+			case 'b': burst = atoi(optarg); break;
+			case 'z': zygotes = atoi(optarg); break;
+			case 't': think = atoi(optarg); break;
+			case 'o': results = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-b burst] [-z zygotes] [-t think] [-o results] [shell]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if(optind < argc) shell = argv[optind];
+	if(iterations < 1 || burst < 1) return EXIT_FAILURE;
+	int rounds = iterations / 10 > 0 ? iterations / 10 : 1; // of the slower measurements
+	struct series exec = { "exec_latency", malloc(iterations * sizeof(double)), 0 };
+	struct series fg = { "fg_roundtrip", malloc(iterations * sizeof(double)), 0 };
+	struct series reap = { "bg_burst_reap", malloc(rounds * sizeof(double)), 0 };
+	struct series sigint = { "sigint_latency", malloc(rounds * sizeof(double)), 0 };
+	struct series sigtstp = { "sigtstp_latency", malloc(rounds * sizeof(double)), 0 };
+	struct series pipeint = { "sigint_pipeline", malloc(rounds * sizeof(double)), 0 };
+	struct series pipetstp = { "sigtstp_pipeline", malloc(rounds * sizeof(double)), 0 };
+
+	if((shellpid = forkpty(&ptyfd, NULL, NULL, NULL)) == -1){
+		perror("forkpty");
+		return EXIT_FAILURE;
+	}
+	if(!shellpid){
+		execl(shell, shell, (char *)NULL);
+		perror(shell);
+		_exit(127);
+	}
+	expect("prompt> ");
+	if(zygotes){
+		char cmd[32];
+		snprintf(cmd, sizeof cmd, "zygote %i\n", zygotes);
+		type(cmd);
+		expect("prompt> ");
+	}
+
+	// prompt-to-exec: the command line is sent until add prints, then until the shell reaped
+	// it and prompts again
+	for(int i = 0; i < iterations; i++){
+		if(think) usleep(think * 1000);
+		double start = now();
+		type("./add 40\n");
+		add(&exec, expect("42 ") - start);
+		add(&fg, expect("prompt> ") - start);
+	}
+
+	// burst of background jobs, until jobs lists none of them
+	for(int r = 0; r < rounds; r++){
+		double start = now();
+		for(int i = 0; i < burst; i++){
+			type("./add 40 &\n");
+			expect("prompt> ");
+		}
+		double done;
+		do{
+			consume();
+			type("jobs\n");
+			done = expect("prompt> ");
+			// the jobs listed are the lines between the command and the next prompt
+		} while(memmem(output, outpos, "Running", 7));
+		add(&reap, done - start);
+	}
+
+	// ^C typed while counter runs in the foreground and ^Z while hello does, until the prompt is back
+	for(int r = 0; r < rounds; r++){
+		type("./counter\n");
+		expect("Counter: 0");
+		double start = now();
+		type("\003");
+		add(&sigint, expect("prompt> ") - start);
+		type("./hello\n");
+		expect("text");
+		start = now();
+		type("\032");
+		add(&sigtstp, expect("prompt> ") - start);
+		type("kill %1\n");
+		expect("prompt> ");
+	}
+
+	// the same with jobs of several processes, every one of them has to get the signal
+	for(int r = 0; r < rounds; r++){
+		type("sleep 60 | sleep 60 | ./counter\n");
+		expect("Counter: 0");
+		double start = now();
+		type("\003");
+		add(&pipeint, expect("prompt> ") - start);
+		type("sleep 60 | ./hello\n");
+		expect("text");
+		start = now();
+		type("\032");
+		add(&pipetstp, expect("prompt> ") - start);
+		type("kill %1\n");
+		expect("prompt> ");
+	}
+
+	long rss = peakRSS(shellpid);
+	type("quit\n");
+	waitpid(shellpid, NULL, 0);
+
+	FILE *f = fopen(results, "w");
+	if(!f){
+		perror(results);
+		return EXIT_FAILURE;
+	}
+	fprintf(f, "{\n  \"shell\": \"%s\",\n  \"iterations\": %i,\n  \"burst\": %i,\n  \"zygotes\": %i,\n  \"think_ms\": %i,\n", shell, iterations, burst, zygotes, think);
+	report(f, &exec, 0);
+	report(f, &fg, 0);
+	report(f, &reap, 0);
+	report(f, &sigint, 0);
+	report(f, &sigtstp, 0);
+	report(f, &pipeint, 0);
+	report(f, &pipetstp, 0);
+	printf("%-22s %li KB\n", "peak_rss", rss);
+	fprintf(f, "  \"peak_rss\": {\"unit\": \"KB\", \"value\": %li}\n}\n", rss);
+	fclose(f);
+	return 0;
+}
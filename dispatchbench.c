@@ -0,0 +1,86 @@
+// Microbenchmark of the builtin dispatch of hw2: a lookup in the perfect-hash table of
+// findBuiltIn against the strcmp chain it replaced, for tables of a growing number of builtins:
+//	gcc -O2 -o dispatchbench dispatchbench.c
+//	./dispatchbench [-n lookups]
+// hw2.c is included to use its hash, the tables are built by the same seed search as
+// initBuiltIns. A lookup is done for each word of a mix of builtins and general commands
+#define main shellmain
+#include "hw2.c"
+#undef main
+
+#define NAMES 256 // builtins of the largest table
+#define WORDS 256 // mix of words looked up, half of them general commands
+
+char names[NAMES][16];
+char words[WORDS][16];
+short *slots = NULL;
+unsigned nslots = 128, seed = 0;
+volatile int sink; // keeps the lookups from being optimized out
+
+// the seed search of initBuiltIns over the first n names
+void buildTable(int n){
+	int collision;
+	nslots = 128;
+	seed = 0;
+	slots = realloc(slots, nslots * sizeof *slots);
+	do{
+		if(++seed % 1000 == 0) slots = realloc(slots, (nslots *= 2) * sizeof *slots);
+		collision = 0;
+		memset(slots, -1, nslots * sizeof *slots);
+		for(int i = 0; i < n && !collision; i++){
+			short *slot = slots + (hashseed(names[i], seed) & (nslots - 1));
+			collision = *slot != -1;
+			*slot = i;
+		}
+	} while(collision);
+}
+
+/* Return the index of the builtin called name, -1 for a general command */
+int lookupHash(const char *name){
+	int i = slots[hashseed(name, seed) & (nslots - 1)];
+	return i != -1 && !strcmp(names[i], name) ? i : -1;
+}
+
+/* Return the index of the builtin called name among the first n, -1 for a general command */
+int lookupChain(const char *name, int n){
+	for(int i = 0; i < n; i++) if(!strcmp(names[i], name)) return i;
+	return -1;
+}
+
+int main(int argc, char **argv){
+	long lookups = 20000000;
+	int opt;
+	while((opt = getopt(argc, argv, "n:")) != -1){
+		if(opt != 'n'){
+			fprintf(stderr, "usage: %s [-n lookups]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		lookups = atol(optarg);
+	}
+	if(lookups < 1) return EXIT_FAILURE;
+	// the real builtins first, then made up ones of the same length
+	int nreal = NBUILTINS < NAMES ? NBUILTINS : NAMES;
+	for(int i = 0; i < NAMES; i++){
+		if(i < nreal) snprintf(names[i], sizeof names[i], "%s", builtins[i].name);
+		else snprintf(names[i], sizeof names[i], "blt%03i", i);
+	}
+	int sizes[] = { 8, nreal, 64, 128, NAMES };
+	printf("%-10s %14s %14s  ns per lookup\n", "builtins", "strcmp chain", "hash table");
+	for(int s = 0; s < (int)(sizeof sizes / sizeof *sizes); s++){
+		int n = sizes[s];
+		buildTable(n);
+		// builtins spread over the whole table, the others are general commands
+		for(int i = 0; i < WORDS; i++){
+			if(i % 2) snprintf(words[i], sizeof words[i], "%s", names[(i * 7) % n]);
+			else snprintf(words[i], sizeof words[i], "./cmd%i", i);
+		}
+		double start = now();
+		for(long i = 0; i < lookups; i++) sink = lookupChain(words[i & (WORDS - 1)], n);
+		double chain = now() - start;
+		start = now();
+		for(long i = 0; i < lookups; i++) sink = lookupHash(words[i & (WORDS - 1)]);
+		double hash = now() - start;
+		printf("%-10i %14.1f %14.1f\n", n, chain * 1e9 / lookups, hash * 1e9 / lookups);
+	}
+	return 0;
+}
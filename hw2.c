@@ -1,5 +1,4 @@
-#define _POSIX_C_SOURCE 200809L
-#define _XOPEN_SOURCE 500
+#define _GNU_SOURCE // splice
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -10,59 +9,644 @@
 #include <ctype.h>
 #include <signal.h>
 #include <fcntl.h> // file descriptor redirection
+#include <errno.h>
+#include <spawn.h> // posix_spawn, vfork-style launch
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <stdarg.h>
+#include <sched.h> // cpu affinity of parallel
+#include <sys/resource.h> // rusage
+#include <sys/time.h>
+#include <stdatomic.h> // trace ring
+#include <sys/socket.h> // zygotes
+#include <stddef.h> // max_align_t of the arena
+#include <sys/sendfile.h> // captured output
+#include <termios.h>
+#include <dirent.h> // the processes of a group in /proc
+#include <sys/syscall.h> // get_mempolicy, set_mempolicy and migrate_pages, libnuma is not needed
 
 #define DEBUG_ENALBED 0
 
 #define MAX_PATH 256 // the current working directory cwd
-#define MAX_LINE 80  // the number of characters entered at the prompt
-#define MAX_ARGC 80  // the number of argument including the starting command
-#define MAX_JOB 5
+#define ARENA_SIZE 4096 // initial size of the arena of a command, grown to fit the longest
+#define CMD_BUCKETS 64 // interned command lines of the jobs, power of 2
+#define MAX_JOB 8 // initial number of job ids, doubled whenever all of them are in use
+#define PATH_BUCKETS 64 // resolved command path cache, power of 2
+#define INPUT_BUFFER 65536 // bytes of stdin read at once
+#define MAX_EVENTS 16 // epoll events handled per wakeup
+#define METER_CHUNK 65536 // bytes moved by one splice of a metered pipe
+#define BUILTIN_SLOTS 128 // initial size of the perfect hash table of the builtins, doubled
+#define TRACE_EVENTS 4096 // job events kept by the trace ring, power of 2
+#define ZYGOTE_MESSAGE 65536 // bytes of the command sent to a zygote, with the environment
+#define ZYGOTE_FD 3 // socket of a zygote
+#define CAPTURE_SIZE (1 << 20) // default size of the ring capturing the output of a job
+#define DONE_JOBS 64 // background jobs that ended whose status wait can still get
+#define CGROUP_EXIT_WAIT 1.0 // seconds the shell waits at exit for the processes of killed jobs
+#define HIST_SUBBITS 4 // 16 buckets per power of 2 in the histograms, values within 6%
+#define HIST_BUCKETS (64 << HIST_SUBBITS)
 // #define currentpgid getpgid(getpid())
 
-// can't do tcsetpgrp because ^z must always go through the shell to update jobs' info
-struct job{
+// a process of a job, one per pipeline stage
+struct proc{
 	int pid;
+	/* 0: running */
+	/* 1: stopped */
+	/* 2: terminated */
+	int state;
+};
+// a foreground job's process group owns the terminal (tcsetpgrp), the shell learns of a ^Z from
+// the SIGCHLD of the stop to update jobs' info
+struct job{
+	int pid; // pgid, the pid of the first stage
+	struct proc *procs;
+	int nprocs;
 	/* -1: unknown */
 	/* 0: bg */
 	/* 1: stopped */
 	/* 2: foreground */
+	/* 3: queued, pid is 0 until it is admitted */
 	int status;
-	/* 0: not terminated */
-	/* 1: terminated */
-	int terminated;
-	char cmd[MAX_LINE];
-} jobs[MAX_JOB] = { [0 ... MAX_JOB - 1] = { -1, -1, 1 } };
-char *argv[MAX_ARGC + 1] = { [0 ... MAX_ARGC] = NULL };
-// not altered by strstok
-char cmdbuffer_unaltered[MAX_LINE] = { [0 ... MAX_LINE - 1] = 0 };
-char cmdbuffer[MAX_LINE] = { [0 ... MAX_LINE - 1] = 0 };
+	// exit status of the last stage, 128 + signal if killed. -1 until it terminates
+	int exitstatus;
+	int termsig; // signal that killed the last stage, 0 if it exited
+	const char *cmd; // interned command line, "" if none
+	struct parallel *par; // the tasks of a parallel job, NULL for a pipeline
+	struct queued *queued; // the command of a queued job, NULL once it runs
+	double start; // now() at launch
+	struct rusage usage; // sum of the terminated processes, ru_maxrss is the max
+	// deadline: timeout seconds after launch the group gets SIGTERM, then SIGKILL grace seconds
+	// later. Kept by a timerfd in the epoll set, -1 if none
+	int timerfd;
+	double timeout, grace;
+	int timedout; // 1 once SIGTERM was sent, 2 once SIGKILL was. Its status is then 124
+	// output of a background job started under capture on, NULL if not captured. Once it
+	// terminated, it moves to donecap until the next captured job with this jid terminates
+	struct capture *cap, *donecap;
+	struct termios *tmodes; // terminal modes of the job when it was stopped in the foreground, NULL if none
+	cpu_set_t *cpus; // placement of its processes (pin), NULL if not pinned
+	int cgroup; // directory of its cgroup job<cgid> (cgroup on), -1 if none
+	unsigned long cgid;
+	int waited; // the wait builtin waits for it to end
+} *jobs = NULL;
+int njobslots = 0; // size of jobs
+int fgjid = -1; // jid of the foreground job, -1 if none
+// figures of the last foreground job when it terminated or stopped, for time. lastwall < 0
+// if none since time started
+struct rusage lastusage;
+double lastwall = -1;
+// every process reaped in the session, for the summary of quit
+struct rusage sessionusage;
+int njobsrun = 0;
+double sessionstart;
+// pid -> (jid, proc) index of every process of every job, open addressing with linear
+// probing (pid 0 marks an empty bucket), kept at most half full
+struct pidslot{
+	int pid;
+	int jid;
+	int proc; // index in jobs[jid].procs
+} *pidindex = NULL;
+int npidbuckets = 0, nindexed = 0;
+// min-heap of the unused jids so the lowest one is still handed out first
+int *freejids = NULL;
+int nfreejids = 0;
+// the words, redirections and stages of the current command are bump allocated from an
+// arena, emptied at once after the command ran. An allocation that doesn't fit gets a block of
+// its own, the arena is then regrown so that the next command that long fits in one block
+char *arena = NULL;
+size_t arenasize = 0, arenaused = 0, arenaoverflow = 0;
+struct arenablock{
+	struct arenablock *next;
+	max_align_t data[];
+} *arenablocks = NULL;
+// command line of a job, interned: the jobs run from the same line share one copy, freed with
+// the last of them
+struct cmdstr{
+	struct cmdstr *next;
+	int refs;
+	char text[];
+} *cmdstrs[CMD_BUCKETS] = { NULL };
+// NULL terminated words of the current command, they point into cmdbuffer
+char **argv = NULL;
+char *argquoted = NULL; // argquoted[i]: part of argv[i] was quoted, it can't be an operator
+char *cmdbuffer = NULL;
+char *cmdline = NULL; // the current command line as typed, not NUL terminated
+size_t cmdlinelen = 0;
+int interactive = 1; // stdin is a terminal and no script is run, prompt> is printed
+// job control: the process group of the foreground job owns the terminal, the kernel sends ^C
+// and ^Z to all of its processes and the shell takes it back once the job stopped or ended.
+// -1 if the shell doesn't own a terminal (a script), it forwards ^C and ^Z to the job then
+int ttyfd = -1;
+int shellpgid = 0;
+struct termios shelltmodes; // restored when the shell takes the terminal back
+int fglaunch = -1; // jid of the job being launched in the foreground, its stages take the terminal
+int fgechoed = 0; // a ^C or ^Z echoed by the terminal reached the foreground job
+int laststatus = 0; // exit status of the last command, also the exit status of the shell
+// redirections of the current command, applied in the child (spawn file actions) for
+// general commands or in the shell for builtins
+// a redirection of a stage, applied in order in the child (or to the temporary streams of a
+// builtin): fd is opened from path, or is a copy of dupfd for N>&M
+struct redirect{
+	int fd;
+	int flags; // open flags
+	const char *path;
+	int dupfd; // -1 if path is opened
+} *redirs = NULL;
+int nredirs = 0;
+// stdin, stdout and stderr of the running builtin, which redirects into temporary fds instead
+// of the shell's own
+int bin = STDIN_FILENO;
+FILE *bout = NULL, *berr = NULL; // stdout and stderr unless redirected
+// a command of the pipeline a | b | c, argv slices are NULL terminated in place
+struct stage{
+	char **argv;
+	int argc;
+	struct redirect *redirs;
+	int nredirs;
+	int in, out; // pipe ends for stdin/stdout, -1 if not piped
+	int metered; // the pipe to the next stage is |:, the shell splices it through a meter
+	int err; // stderr, -1 if not captured
+} *stages = NULL;
+int nstages = 0;
+// metered pipe: the writing stage fills in, the shell splices in into out, which the reading
+// stage drains. Data never goes through the shell's memory
+struct meter{
+	int in, out; // -1 once closed
+	int jid; // -1 if the slot is unused
+	int blocked; // out is full, wait for EPOLLOUT on out instead of EPOLLIN on in
+	long long bytes;
+	double start, end;
+} *meters = NULL;
+int nmeters = 0;
+// captured output of a job: the stdout of its last stage and the stderr of all of them go to a
+// pipe the shell splices into a memfd, a ring keeping the last size bytes
+struct capture{
+	int rd, wr; // the pipe, -1 once closed. The shell keeps wr until the job is launched
+	int memfd;
+	char *map; // the memfd mapped, to find lines
+	size_t size;
+	unsigned long long len; // bytes captured, the ring holds the last size of them
+	int follow; // fd the new output is copied to as well (fg, output -f), -1 if none
+};
+int captureon = 0; // the background jobs are captured
+size_t capturesize = CAPTURE_SIZE;
+int capturenext = 0; // the job the command creates is captured
+// parallel -j N: a job running one task per argument, at most njobs at once. A finished task's
+// slot is given the next argument right away
+struct parallel{
+	char *strings; // the template words and the arguments
+	char **tmpl;
+	int ntmpl;
+	char **args;
+	int nargs;
+	int next; // index of the next argument to run
+	int njobs;
+	int running;
+	int *slottask; // task running in each slot, -1 if free
+	int *proctask; // task of each process of the job
+	int *exits; // exit status of each task, -1 if not run (yet)
+	int *cpus; // --pin: slot i runs on cpus[i % ncpus]
+	int ncpus; // 0 if not pinned
+	int in, out; // the stdin and stdout of the tasks
+	int failed;
+};
+int background = 0; // the command ended with &
+// admission of the background jobs: past limitjobs running jobs, or while the host is loaded,
+// a job waits in the queue until one terminates. The highest prio is admitted first, then the
+// oldest
+struct queued{
+	int prio;
+	unsigned long seq;
+	int nstages;
+	struct stage *stages; // copied with their words, in the same block
+};
+int limitjobs = 0; // 0: no limit
+double limitload = 0; // 1 minute /proc/loadavg admitting jobs, 0: not checked
+double limitpsi = 0; // "some avg10" of /proc/pressure/cpu admitting jobs, 0: not checked
+unsigned long queueseq = 0;
+int queuefd = -1; // timerfd checking the load again while admission is throttled
+// deadline given by timeout to the job its command creates
+double nexttimeout = 0, nextgrace = 0;
+// placement: the processes of a pinned job are launched on its cpus, with their memory bound to
+// the NUMA nodes of those cpus on a host with several
+#define MPOL_DEFAULT 0
+#define MPOL_BIND 2
+#define MPOL_MF_MOVE (1 << 1)
+cpu_set_t shellcpus; // the shell's own affinity, where the jobs not pinned run
+// the shell's own memory policy, such as one given by numactl, the jobs not pinned get it
+int shellmempolicy = MPOL_DEFAULT;
+unsigned long shellnodes = 0;
+cpu_set_t *nextpin = NULL; // cpus given by pin to the job its command creates
+int pinwidth = 0; // pin auto: each & job gets the next pinwidth cpus of the shell's, 0 if off
+int pinnext = 0; // index in shellcpus of the first cpu of the next one
+cpu_set_t *nodecpus = NULL; // the cpus of each NUMA node
+int nnodes = -1; // -1 until read from /sys, at most 64
+// cgroup on: each job runs in a cgroup v2 of its own, where ^Z, fg and bg freeze and thaw all of
+// its processes at once and kill kills them, the ones that left its process group too. Without
+// a cgroup v2 hierarchy the shell can write to, the jobs are signaled like before
+int cgroupon = 0;
+int cgroupfd = -1; // the shell's subtree hw2.<pid>, -1 until set up. The jobs' cgroups are in it
+int cgprocsfd = -1; // cgroup.procs of its leaf "shell", where the shell moved itself
+unsigned long cgseq = 0;
+char cgmemmax[32] = "", cgcpumax[32] = ""; // limits of the jobs started from now on, "" if none
+// flags of a builtin
+#define BI_BACKGROUND 1 // can be run in the background with a trailing &
+#define BI_PREFIX 2 // runs the command given as its arguments, which are passed unparsed
+// stands in for the program of the same name, which runs instead as a job in the background,
+// in a pipeline or under timeout or pin
+#define BI_UTILITY 4
+// a utility that waits, it runs as its program in the foreground too when the shell has a
+// terminal: ^Z can stop a job but not the shell
+#define BI_WAITS 8
+// a builtin of the shell. Adding one only takes a new entry in builtins
+struct builtin{
+	const char *name;
+	int (*run)(int argc, int jid);
+	int minargc, maxargc; // including the name, maxargc -1: no maximum
+	// argv[1] must name a job (%jid or pid) whose status is in this mask (1 << status), 0 if
+	// the builtin doesn't take a job
+	int jobstatus;
+	int flags;
+};
+// the next command is looked up as a builtin only (builtin, 1) or a program only (command, -1)
+int forcelookup = 0;
+int inwait = 0; // 1 while a builtin waits in the event loop (sleep, output -f), 2 once ^C interrupted it
+int sleepfd = -1; // timerfd ending the sleep builtin, or the wait of wait --timeout
+// wait: the jobs it waits for are flagged and counted down by waitDone as they end, a wakeup of
+// the event loop doesn't look at every one of them
+int nwaiting = 0;
+int waitany = 0; // wait -n: 1 until the first one ends, then 2
+int waitlast = -1; // the last job listed, its status is the one of wait
+int waitstatus = 0;
+// the background jobs that ended before wait was called, oldest first. Forgotten once waited
+// for, or once their jid is taken again
+struct donejob{
+	int jid, pid, status;
+} donejobs[DONE_JOBS];
+int ndonejobs = 0;
+// zygote pool (zygote N): processes started ahead, each waiting on a socket for a command to
+// exec. A launch is then a sendmsg and the exec, the process creation was paid while the shell
+// was idle. A zygote is the shell's binary run again as hw2 --zygote rather than a fork, so
+// its exec doesn't have to tear down a copy of the shell's memory. It is a child of the shell,
+// once it exec'd it is a job process like any other
+struct zygote{
+	int pid;
+	int sock; // the shell's end of the socketpair
+} *zygotes = NULL;
+int nzygotes = 0; // idle ones
+int zygotepool = 0; // zygotes kept ready, 0: commands are launched with posix_spawn
+unsigned long zygotelaunches = 0;
+// the command sent to a zygote, followed by the path, the cwd, argv and environ, each \0
+// terminated. Its stdin, stdout and stderr are passed along as SCM_RIGHTS
+struct zygotecmd{
+	int pgid;
+	int argc, envc;
+	int tty; // the process group takes the terminal
+};
+extern char **environ;
+// command name -> resolved $PATH location, like bash's hash table. Flushed when $PATH or
+// the mtime of one of its directories changes
+struct pathent{
+	char *name;
+	char *path;
+	int dir; // index of the $PATH directory where the command was found
+	unsigned hits;
+	struct pathent *next;
+} *pathcache[PATH_BUCKETS] = { NULL };
+struct pathdir{
+	char *dir;
+	struct timespec mtime;
+} *pathdirs = NULL;
+int npathdirs = 0;
+char *cachedPATH = NULL; // value of $PATH the directories were split from
+// the shell runs an epoll loop over stdin and a signalfd, SIGCHLD, SIGINT and SIGTSTP are
+// blocked and handled synchronously instead of in signal handlers
+int epfd = -1;
+int sigfd = -1;
+int stdinpollable = 1; // 0 if stdin is a regular file, which epoll doesn't support
+int atprompt = 0; // waiting for the next command line after printing prompt>
+// epoll_event.data.u64 of an event source, the kind in the high 32 bits
+#define EVENT(kind, id) (((uint64_t)(kind) << 32) | (uint32_t)(id))
+enum{ EV_STDIN, EV_SIGNAL, EV_METER_IN, EV_METER_OUT, EV_NOTIFY, EV_QUEUE, EV_TIMEOUT, EV_SLEEP, EV_CAPTURE, EV_STATS };
+// stdin read ahead, lines are taken out of it one at a time. Grown to fit the longest line.
+// A script file is mapped here as a whole instead
+char *inbuf = NULL;
+size_t inpos = 0, inlen = 0, insize = 0;
+int ineof = 0;
 /* int fd; // fd of he current terminal */
+// "[N] Done cmd" notices of the jobs that terminated or stopped, printed as soon as they happen
+// while the shell waits at the prompt (unless notify off), or before the next prompt
+char *notices = NULL;
+size_t noticeslen = 0, noticessize = 0;
+int notifynow = 1; // 0: only before the next prompt, like bash without set -b
+int notifywindow = 0; // ms the notices are batched for, 0 to print them right away
+int notifyfd = -1; // timerfd ending the batch window, created by notify -w
+int notifyarmed = 0;
+// ring of the last TRACE_EVENTS job events, always recorded. A writer takes a slot with one
+// atomic increment and publishes it with seq, nothing locks or allocates so an event can be
+// recorded from a signal handler
+enum{ TR_FORK, TR_EXEC, TR_SETPGID, TR_SIGNAL, TR_STOP, TR_CONT, TR_REAP, TR_RESET };
+const char *tracenames[] = { "fork", "exec", "setpgid", "signal", "stop", "cont", "reap", "reset" };
+struct trace{
+	atomic_ulong seq; // index + 1 of the event once written, the slot is being written otherwise
+	long long ns; // CLOCK_MONOTONIC
+	int kind;
+	int jid; // -1 if none
+	int pid;
+	int arg; // pgid (fork, setpgid), signal (signal, stop) or exit status (reap, reset)
+} traces[TRACE_EVENTS];
+atomic_ulong tracehead = 0; // number of events recorded since the start
+unsigned long tracestart = 0; // events before are cleared
+// counters of the stats builtin. Only the shell's thread writes them, an update is a plain
+// increment
+struct{
+	unsigned long commands; // command lines parsed
+	unsigned long spawns; // processes started by posix_spawn
+	unsigned long forks; // fork fallbacks, for the files posix_spawn can't exec (ENOEXEC)
+	unsigned long launchfailures; // stages that couldn't be started
+	unsigned long reaped; // job processes that terminated
+	unsigned long orphans; // children reaped that were no job's anymore (killed jobs, zygotes)
+	unsigned long sigint, sigtstp; // ^C and ^Z that reached the foreground job, forwarded or not
+} stats;
+// log-linear histogram of microseconds like HdrHistogram: the bucket of a value is its power of
+// 2 and its next HIST_SUBBITS bits, so any value is kept within 1 / 2^HIST_SUBBITS
+struct histogram{
+	unsigned long counts[HIST_BUCKETS];
+	unsigned long n;
+	double sum; // seconds
+} spawnhist, lifetimehist;
+char *statspath = NULL; // Prometheus textfile written every statsinterval seconds, NULL if none
+int statsfd = -1; // its timerfd
 
 // forward declare
-void SIGCHLDhandler(int signal);
-void SIGINThandler(int signal);
-void SIGTSTPhandler(int signal);
+double now();
+void closeMeter(struct meter *m);
+void flushPathCache();
+void freeParallel(struct parallel *p);
+void taskExited(int jid, int proc, int stat_loc);
+void runTasks(int jid);
+int resumeTasks(int jid);
+void parallelDone(int jid);
+int isop(char **arg, const char *op);
+void admitJobs();
+struct capture *newCapture(int jid);
+void freeCapture(struct capture *c);
+void pumpCapture(struct capture *c);
+void writeStats();
+void refillZygotes();
+int armTimeout(int jid, double seconds);
+int launchQueued(int jid);
+void newCgroup(int jid);
+void sweepCgroups();
+int freezeJob(int jid, int freeze);
+int forgetDoneJob(int jid, int pid);
+struct builtin *findBuiltIn(const char *name);
+
+// queue a notice, printed by flushNotices
+void notice(const char *fmt, ...){
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if(noticessize - noticeslen <= (size_t)n){
+		size_t size = noticessize ? noticessize : 256;
+		while(size - noticeslen <= (size_t)n) size *= 2;
+		char *newnotices = realloc(notices, size);
+		if(!newnotices) return;
+		notices = newnotices;
+		noticessize = size;
+	}
+	va_start(ap, fmt);
+	noticeslen += vsnprintf(notices + noticeslen, noticessize - noticeslen, fmt, ap);
+	va_end(ap);
+	// a flood of notices is printed once the window ends
+	if(notifywindow && !notifyarmed){
+		struct itimerspec t = { { 0, 0 }, { notifywindow / 1000, notifywindow % 1000 * 1000000L } };
+		notifyarmed = timerfd_settime(notifyfd, 0, &t, NULL) != -1;
+	}
+}
+
+// print the queued notices. At the prompt, they go on the next line and the prompt is printed
+// again below them. The prompt line is left as it is: the terminal still holds what was typed
+// on it, which can't be echoed again in canonical mode
+void flushNotices(){
+	if(!noticeslen) return;
+	if(atprompt) printf("\n%.*sprompt> ", (int)noticeslen, notices);
+	else printf("%.*s", (int)noticeslen, notices);
+	noticeslen = 0;
+}
+
+// queue the notice of job jid, which terminated (status 2) or stopped (1)
+void noticeJob(int jid, int status){
+	struct job *j = jobs + jid;
+	// a script doesn't report its jobs
+	if(!interactive) return;
+	if(status == 1) notice("[%i] Stopped %s\n", jid + 1, j->cmd);
+	else if(j->timedout) notice("[%i] Timed out %s\n", jid + 1, j->cmd);
+	else if(j->termsig) notice("[%i] Killed (SIG%s) %s\n", jid + 1, sigabbrev_np(j->termsig), j->cmd);
+	else if(j->exitstatus) notice("[%i] Exit %i %s\n", jid + 1, j->exitstatus, j->cmd);
+	else notice("[%i] Done %s\n", jid + 1, j->cmd);
+}
+
+// record an event, async-signal-safe
+void trace(int kind, int jid, int pid, int arg){
+	unsigned long i = atomic_fetch_add(&tracehead, 1);
+	struct trace *t = traces + (i & (TRACE_EVENTS - 1));
+	struct timespec ts;
+	atomic_store_explicit(&t->seq, 0, memory_order_relaxed);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t->ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	t->kind = kind;
+	t->jid = jid;
+	t->pid = pid;
+	t->arg = arg;
+	atomic_store_explicit(&t->seq, i + 1, memory_order_release);
+}
+
+unsigned histIndex(uint64_t us){
+	if(us < 1 << HIST_SUBBITS) return us;
+	int shift = 63 - __builtin_clzll(us) - HIST_SUBBITS;
+	return ((shift + 1) << HIST_SUBBITS) + (us >> shift) - (1 << HIST_SUBBITS);
+}
+
+/* Return the highest value in microseconds of histogram bucket i */
+uint64_t histValue(unsigned i){
+	if(i < 1 << HIST_SUBBITS) return i;
+	int shift = (i >> HIST_SUBBITS) - 1;
+	return (((uint64_t)(i & ((1 << HIST_SUBBITS) - 1)) + (1 << HIST_SUBBITS) + 1) << shift) - 1;
+}
+
+void histRecord(struct histogram *h, double seconds){
+	h->counts[histIndex(seconds > 0 ? seconds * 1e6 : 0)]++;
+	h->n++;
+	h->sum += seconds;
+}
+
+/* Return the value in microseconds below which a fraction q of the histogram is */
+uint64_t histQuantile(struct histogram *h, double q){
+	unsigned long rank = q * h->n, seen = 0;
+	if(rank >= h->n) rank = h->n - 1;
+	for(unsigned i = 0; i < HIST_BUCKETS; i++){
+		if(!h->counts[i]) continue;
+		if((seen += h->counts[i]) > rank) return histValue(i);
+	}
+	return 0;
+}
+
+// a stage was started at start, pid -1 if it failed
+void recordLaunch(double start, int pid){
+	if(pid == -1) stats.launchfailures++;
+	else histRecord(&spawnhist, now() - start);
+}
+
+/* Return n bytes of the arena, NULL if out of memory */
+void *arenaAlloc(size_t n){
+	n = (n + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+	if(arenasize - arenaused >= n){
+		arenaused += n;
+		return arena + arenaused - n;
+	}
+	struct arenablock *b = malloc(sizeof *b + n);
+	if(!b) return NULL;
+	b->next = arenablocks;
+	arenablocks = b;
+	arenaoverflow += n;
+	return b->data;
+}
+
+// free what the command allocated, nothing but a reset unless it overflowed
+void arenaReset(){
+	arenaused = 0;
+	if(!arenablocks) return;
+	while(arenablocks){
+		struct arenablock *b = arenablocks;
+		arenablocks = b->next;
+		free(b);
+	}
+	size_t size = arenasize ? arenasize : ARENA_SIZE;
+	while(size < arenasize + arenaoverflow) size *= 2;
+	char *newarena = malloc(size);
+	if(newarena){
+		free(arena);
+		arena = newarena;
+		arenasize = size;
+	}
+	arenaoverflow = 0;
+}
+
+unsigned cmdhash(const char *s, size_t len){
+	unsigned h = 2166136261u;
+	while(len--) h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h & (CMD_BUCKETS - 1);
+}
+
+/* Return the interned copy of the len characters of s, "" if out of memory */
+const char *internCmd(const char *s, size_t len){
+	struct cmdstr **bucket = cmdstrs + cmdhash(s, len);
+	struct cmdstr *e = *bucket;
+	while(e && (strncmp(e->text, s, len) || e->text[len])) e = e->next;
+	if(!e){
+		if(!(e = malloc(sizeof *e + len + 1))) return "";
+		memcpy(e->text, s, len);
+		e->text[len] = 0;
+		e->refs = 0;
+		e->next = *bucket;
+		*bucket = e;
+	}
+	e->refs++;
+	return e->text;
+}
+
+// drop a reference to an interned command line
+void releaseCmd(const char *text){
+	if(!*text) return;
+	struct cmdstr *e = (struct cmdstr *)(text - offsetof(struct cmdstr, text));
+	if(--e->refs) return;
+	struct cmdstr **p = cmdstrs + cmdhash(text, strlen(text));
+	while(*p != e) p = &(*p)->next;
+	*p = e->next;
+	free(e);
+}
+
+// job jid runs the current command line
+void setJobCmd(int jid){
+	releaseCmd(jobs[jid].cmd);
+	jobs[jid].cmd = internCmd(cmdline, cmdlinelen);
+}
 
 // check if there is a foreground job, return jid is true, -1 otherwise
 int getfjid(){
-	for(int i = 0; i < MAX_JOB; i++){
-		if(jobs[i].status == 2) return i;
+	return fgjid;
+}
+
+unsigned pidbucket(int pid){
+	return ((unsigned)pid * 2654435761u) & (npidbuckets - 1);
+}
+
+// return the bucket of pid, or the empty bucket ending its probe sequence
+struct pidslot *findpid(int pid){
+	unsigned i = pidbucket(pid);
+	while(pidindex[i].pid && pidindex[i].pid != pid) i = (i + 1) & (npidbuckets - 1);
+	return pidindex + i;
+}
+
+// rebuild the pid index with n buckets, return 0 if out of memory
+int resizepidindex(int n){
+	struct pidslot *old = pidindex;
+	int nold = npidbuckets;
+	if(!(pidindex = calloc(n, sizeof *pidindex))){
+		pidindex = old;
+		return 0;
 	}
-	return -1;
+	npidbuckets = n;
+	for(int i = 0; i < nold; i++){
+		if(old[i].pid) *findpid(old[i].pid) = old[i];
+	}
+	free(old);
+	return 1;
+}
+
+// index process proc of job jid, return 0 if out of memory
+int indexpid(int pid, int jid, int proc){
+	if(2 * (nindexed + 1) > npidbuckets && !resizepidindex(npidbuckets ? 2 * npidbuckets : 2 * MAX_JOB)) return 0;
+	*findpid(pid) = (struct pidslot){ pid, jid, proc };
+	nindexed++;
+	return 1;
 }
 
-// convert pid to jid [0, MAX_JOB), return -1 if failed
+void unindexpid(int pid){
+	unsigned mask = npidbuckets - 1;
+	struct pidslot *slot = findpid(pid);
+	if(!slot->pid) return;
+	unsigned i = slot - pidindex;
+	// shift back the following entries of the probe sequence instead of leaving a tombstone
+	for(unsigned j = (i + 1) & mask; pidindex[j].pid; j = (j + 1) & mask){
+		unsigned home = pidbucket(pidindex[j].pid);
+		// move j into the hole at i unless its home bucket lies cyclically in (i, j]
+		if(((j - home) & mask) >= ((j - i) & mask)){
+			pidindex[i] = pidindex[j];
+			i = j;
+		}
+	}
+	pidindex[i].pid = 0;
+	nindexed--;
+}
+
+// convert pid to jid [0, njobslots), return -1 if failed
 // int pid, not unsigned pid because atoi can return negative number
 int pidtojid(int pid){
 	// pid should > 0 otherwise an error because atoi return 0 on error
-	if(pid > 0){
-		for(int i = 0; i < MAX_JOB; i++){
-			if(jobs[i].pid == pid){
+	if(pid > 0 && npidbuckets){
+		struct pidslot *slot = findpid(pid);
+		if(slot->pid){
 #if DEBUG_ENALBED
-				printf("pid [%u] converted to jid [%i]\n", pid, i);
+			printf("pid [%u] converted to jid [%i]\n", pid, slot->jid);
 #endif
-				return i;
-			}
+			return slot->jid;
 		}
 	}
 #if DEBUG_ENALBED
@@ -71,13 +655,90 @@ int pidtojid(int pid){
 	return -1;
 }
 
-// return jid from argv if issued builtin cmd such as 'fg', 'bg' or 'kill',
-// otherwise return -1 if not avail
-int getcmdjid(){
-	if(argv[1] != NULL){
-		if(*argv[1] == '%'){ // jid
-			int jid = atoi(argv[1] + 1) - 1;
-			if(0 <= jid && jid < MAX_JOB && jobs[jid].pid != -1){
+void pushfreejid(int jid){
+	int i = nfreejids++;
+	// sift up
+	while(i && freejids[(i - 1) / 2] > jid){
+		freejids[i] = freejids[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	freejids[i] = jid;
+}
+
+int popfreejid(){
+	int top = freejids[0];
+	int last = freejids[--nfreejids];
+	int i = 0;
+	// sift down
+	while(2 * i + 1 < nfreejids){
+		int child = 2 * i + 1;
+		if(child + 1 < nfreejids && freejids[child + 1] < freejids[child]) child++;
+		if(freejids[child] >= last) break;
+		freejids[i] = freejids[child];
+		i = child;
+	}
+	freejids[i] = last;
+	return top;
+}
+
+// double the number of job ids, return 0 if out of memory
+int growjobs(){
+	int n = njobslots ? 2 * njobslots : MAX_JOB;
+	struct job *newjobs = realloc(jobs, n * sizeof *jobs);
+	int *newfree = realloc(freejids, n * sizeof *freejids);
+	if(newjobs) jobs = newjobs;
+	if(newfree) freejids = newfree;
+	if(!newjobs || !newfree) return 0;
+	for(int i = njobslots; i < n; i++){
+		jobs[i] = (struct job){ .pid = -1, .status = -1, .exitstatus = -1, .cmd = "", .timerfd = -1, .cgroup = -1 };
+		pushfreejid(i);
+	}
+	njobslots = n;
+	return 1;
+}
+
+// take the jid returned by lowestAvailJID for a job whose process group is pgid. A queued job
+// has its jid already
+void setjobpid(int jid, int pgid){
+	if(jobs[jid].pid == -1){
+		popfreejid(); // == jid
+		forgetDoneJob(jid, -1);
+		jobs[jid].cap = capturenext ? newCapture(jid) : NULL;
+		capturenext = 0;
+		if(cgroupon) newCgroup(jid);
+	}
+	jobs[jid].pid = pgid;
+	jobs[jid].start = now();
+	memset(&jobs[jid].usage, 0, sizeof jobs[jid].usage);
+	if(nexttimeout){
+		jobs[jid].timeout = nexttimeout;
+		jobs[jid].grace = nextgrace;
+		nexttimeout = 0;
+	}
+	if(nextpin){
+		free(jobs[jid].cpus);
+		jobs[jid].cpus = nextpin;
+		nextpin = NULL;
+	}
+	njobsrun++;
+}
+
+// add a process to job jid, return 0 if out of memory
+int addjobproc(int jid, int pid){
+	struct proc *procs = realloc(jobs[jid].procs, (jobs[jid].nprocs + 1) * sizeof *procs);
+	if(!procs) return 0;
+	jobs[jid].procs = procs;
+	if(!indexpid(pid, jid, jobs[jid].nprocs)) return 0;
+	procs[jobs[jid].nprocs++] = (struct proc){ pid, 0 };
+	return 1;
+}
+
+// return jid from spec %jid or pid, otherwise return -1 if not avail
+int getjid(const char *spec){
+	if(spec != NULL){
+		if(*spec == '%'){ // jid
+			int jid = atoi(spec + 1) - 1;
+			if(0 <= jid && jid < njobslots && jobs[jid].pid != -1){
 #if DEBUG_ENALBED
 				printf("job id [jid:%i, pid:%i] returned\n", jid, jobs[jid].pid);
 #endif
@@ -85,7 +746,7 @@ int getcmdjid(){
 			}
 		}
 		else{ // pid
-			int jid = pidtojid(atoi(argv[1]));
+			int jid = pidtojid(atoi(spec));
 			if(jid != -1){
 #if DEBUG_ENALBED
 				printf("job id [%i] returned\n", jid);
@@ -100,526 +761,3229 @@ int getcmdjid(){
 	return -1;
 }
 
-// return the lowest available job id (index of jobs)
-int lowestAvailJID(){
-	for(int i = 0; i < MAX_JOB; i++){
-		if(jobs[i].pid == -1) return i;
+// return jid from argv if issued builtin cmd such as 'fg', 'bg' or 'kill',
+// otherwise return -1 if not avail
+int getcmdjid(){
+	return getjid(argv[1]);
+}
+
+/* Forget the background job that ended as jid (or whose pid is pid), return its status or -1 if
+ * there is none */
+int forgetDoneJob(int jid, int pid){
+	for(int i = 0; i < ndonejobs; i++){
+		if(donejobs[i].jid != jid && donejobs[i].pid != pid) continue;
+		int status = donejobs[i].status;
+		memmove(donejobs + i, donejobs + i + 1, (--ndonejobs - i) * sizeof *donejobs);
+		return status;
 	}
-	// no job id is available
 	return -1;
 }
 
-// reset job and return foreground group of the current terminal to current process
+// job jid that wait waits for ended with status, or stopped
+void waitDone(int jid, int status){
+	if(!jobs[jid].waited) return;
+	jobs[jid].waited = 0;
+	nwaiting--;
+	if(waitany == 1 || (!waitany && jid == waitlast)) waitstatus = status;
+	if(waitany) waitany = 2;
+	if((waitany || !nwaiting) && inwait == 1) inwait = 0;
+}
+
+// return the lowest available job id (index of jobs), the table grows if all are in use
+int lowestAvailJID(){
+	if(!nfreejids && !growjobs()){
+		// out of memory
+		return -1;
+	}
+	return freejids[0];
+}
+
+// reset job, waitfgjob takes the terminal back
 void resetjob(unsigned jid){
-	if(0 <= jid && jid < MAX_JOB){
+	if(jid < (unsigned)njobslots && jobs[jid].pid != -1){
 #if DEBUG_ENALBED
 		printf("jid [%u] reseted\n", jid);
 #endif
+		trace(TR_RESET, jid, jobs[jid].pid, jobs[jid].exitstatus);
+		// killed by kill if it has no status
+		int status = jobs[jid].exitstatus != -1 ? jobs[jid].exitstatus : 128 + SIGKILL;
+		if(jobs[jid].waited) waitDone(jid, status);
+		else if(jobs[jid].pid > 0 && jobs[jid].status != 2){
+			if(ndonejobs == DONE_JOBS) memmove(donejobs, donejobs + 1, --ndonejobs * sizeof *donejobs);
+			donejobs[ndonejobs++] = (struct donejob){ jid, jobs[jid].pid, status };
+		}
+		if(jobs[jid].pid > 0) histRecord(&lifetimehist, now() - jobs[jid].start);
+		for(int i = 0; i < jobs[jid].nprocs; i++) unindexpid(jobs[jid].procs[i].pid);
+		free(jobs[jid].procs);
+		jobs[jid].procs = NULL;
+		jobs[jid].nprocs = 0;
+		for(int i = 0; i < nmeters; i++){
+			if(meters[i].jid == (int)jid){
+				// a killed job leaves its meters open, the writing stage gets EPIPE
+				closeMeter(meters + i);
+				meters[i].jid = -1;
+			}
+		}
+		if(jobs[jid].par){
+			freeParallel(jobs[jid].par);
+			jobs[jid].par = NULL;
+		}
+		free(jobs[jid].queued);
+		jobs[jid].queued = NULL;
+		free(jobs[jid].tmodes);
+		jobs[jid].tmodes = NULL;
+		free(jobs[jid].cpus);
+		jobs[jid].cpus = NULL;
+		// removed once its last process exited, see sweepCgroups
+		if(jobs[jid].cgroup != -1){
+			close(jobs[jid].cgroup);
+			jobs[jid].cgroup = -1;
+			sweepCgroups();
+		}
+		// what is left in the pipe, a process still holding it doesn't keep it open
+		if(jobs[jid].cap){
+			struct capture *c = jobs[jid].cap;
+			pumpCapture(c);
+			if(c->rd != -1) close(c->rd);
+			if(c->wr != -1) close(c->wr);
+			c->rd = c->wr = -1;
+			freeCapture(jobs[jid].donecap);
+			jobs[jid].donecap = c;
+			jobs[jid].cap = NULL;
+		}
+		// closing removes it from epoll
+		if(jobs[jid].timerfd != -1) close(jobs[jid].timerfd);
+		jobs[jid].timerfd = -1;
+		jobs[jid].timeout = jobs[jid].grace = 0;
+		jobs[jid].timedout = 0;
+		pushfreejid(jid);
+		if(fgjid == (int)jid) fgjid = -1;
 		jobs[jid].pid = -1;
 		jobs[jid].status = -1;
-		jobs[jid].terminated = 1;
-		strcpy(jobs[jid].cmd, "");
+		jobs[jid].exitstatus = -1;
+		jobs[jid].termsig = 0;
+		releaseCmd(jobs[jid].cmd);
+		jobs[jid].cmd = "";
 	}
 #if DEBUG_ENALBED
 	else printf("can't reset jid [%u]\n", jid);
 #endif
-	// return the foreground group to the current process
-	// tcsetpgrp(fd, currentpgid);
-}
-
-/* Create a new process group id and set the foreground group to that pgid. Must be called
- * by both the parent and the child to set the fgpid properly regardless of which process
- * is scheduled first */
-/* Return 0 if success */
-/* Return -1 if fail */
-	// int newPgidSetsFgroup(int fd, unsigned pid){
-	// 	// if pid = 0 (child) then setpid(0, 0)
-	// 	if(setpgid(pid, pid) != -1){
-	// 		// pid = 0 (child), can't be use
-	// 		if(!pid) return 0;
-	// 		// pid = child pid, use to set the fg pid
-	// 		else if(tcsetpgrp(fd, pid) != -1) return 0;
-	// 		perror(NULL);
-	// 	}
-	// 	perror(NULL);
-	// 	return -1;
-	// }
+}
 
 // =========================== SUPPORT FUNCTIONS =========================== 
 
-void SIGCHLDhandler(int signal){
-	// child terminated (SIGINT, or returned from exec's program) or stopped (SIGTSTP)
-#if DEBUG_ENALBED
-	printf("caught SIGCHLD\n");
-#endif
-	int stat_loc;
-	// wait for a process to stop (not reap) or terminate (reap) and report the status
-	int pid = waitpid(-1, &stat_loc, WNOHANG);
-#if DEBUG_ENALBED
-	printf("sigchld pid: %i\n", pid);
-#endif
-	if(pid && pid != -1){
-		int jid = pidtojid(pid);
-		// this conditional statment is trival when processBuiltInQuit called succesfully returned
-		// otherwise, 
-		if(jid != -1 && jobs[jid].terminated) resetjob(jid);
+// add the usage of a terminated process ru to sum
+void addUsage(struct rusage *sum, const struct rusage *ru){
+	timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+	timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+	if(ru->ru_maxrss > sum->ru_maxrss) sum->ru_maxrss = ru->ru_maxrss;
+	sum->ru_minflt += ru->ru_minflt;
+	sum->ru_majflt += ru->ru_majflt;
+	sum->ru_nvcsw += ru->ru_nvcsw;
+	sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+// keep the figures of job jid, which leaves the foreground
+void recordfg(int jid){
+	lastusage = jobs[jid].usage;
+	lastwall = now() - jobs[jid].start;
+}
+
+// job jid has none of its processes running anymore
+void jobStopped(int jid){
+	jobs[jid].status = 1;
+	// it won't end while stopped, like bash
+	waitDone(jid, 128 + SIGTSTP);
+	if(fgjid == jid){
+		recordfg(jid);
+		fgjid = -1;
 	}
-#if DEBUG_ENALBED
-	else if(pid == -1) perror(NULL);
-	// pid = 0
-	else printf("no state change detected\n");
-#endif
-	/* printf("\n"); // print a line feed to push prompt> into newline */
+	noticeJob(jid, 1);
 }
 
-void SIGINThandler(int signal){
-	// SIGINT is fowarded to every jobs the shell created. Sent SIGINT only to the
-	// foreground process, whose pid == pgid != parent process pid
+// reap or update every child whose state changed. SIGCHLDs that arrive together are merged
+// into one, so waitpid is called until there is nothing left instead of once per signal
+void reapChildren(){
+	int stat_loc;
+	int pid;
+	struct rusage ru;
+	// wait4 is waitpid returning the resource usage of a terminated child
+	while((pid = wait4(-1, &stat_loc, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0){
+		if(WIFEXITED(stat_loc) || WIFSIGNALED(stat_loc)) addUsage(&sessionusage, &ru);
+		// a zygote can end before any job was indexed, there is no index to look in then
+		struct pidslot *slot = npidbuckets ? findpid(pid) : NULL;
 #if DEBUG_ENALBED
-	printf("caught SIGINT\n");
+		printf("state change of pid [%i] (jid [%i])\n", pid, slot && slot->pid ? slot->jid : -1);
 #endif
-	// if there is a foreground job
-	int fjid = getfjid();
-	if(fjid != -1){
-	// if(tcgetpgrp(fd) != currentpgid){
-		// sent SIGINT to all processes in the foreground
-		// killpg(tcgetpgrp(fd), SIGINT);
-		jobs[fjid].terminated = 1;
-		kill(jobs[fjid].pid, SIGINT);
-		// resetjob(tcgetpgrp(fd));
-		/* resetjob(fjid); */
-	}
+		// not a job anymore, such as a killed job that was already reset
+		if(!slot || !slot->pid){
+			if(WIFEXITED(stat_loc) || WIFSIGNALED(stat_loc)){
+				stats.orphans++;
+				sweepCgroups();
+			}
+			continue;
+		}
+		if(WIFEXITED(stat_loc) || WIFSIGNALED(stat_loc)) stats.reaped++;
+		int jid = slot->jid;
+		struct job *j = jobs + jid;
+		// the shell didn't see the ^C or ^Z, what follows goes on the line after the one echoed
+		int sigint = WIFSIGNALED(stat_loc) && WTERMSIG(stat_loc) == SIGINT;
+		if(fgjid == jid && ttyfd != -1 && !fgechoed && (sigint || (WIFSTOPPED(stat_loc) && WSTOPSIG(stat_loc) == SIGTSTP))){
+			fgechoed = 1;
+			if(sigint) stats.sigint++;
+			else stats.sigtstp++;
+			printf("\n");
+		}
+		if(WIFSTOPPED(stat_loc)){
+			trace(TR_STOP, jid, pid, WSTOPSIG(stat_loc));
+			j->procs[slot->proc].state = 1;
+			if(fgjid == jid) laststatus = 128 + WSTOPSIG(stat_loc);
+			// one of them got ^Z, the cgroup stops the others too
+			if(j->status != 1) freezeJob(jid, 1);
+			// the job is stopped once none of its processes is running
+			int running = 0;
+			for(int i = 0; i < j->nprocs; i++) running |= j->procs[i].state == 0;
+			if(!running) jobStopped(jid);
+		}
+		else if(WIFCONTINUED(stat_loc)){
+			trace(TR_CONT, jid, pid, 0);
+			j->procs[slot->proc].state = 0;
+			// continued by someone else than fg or bg
+			if(j->status == 1) j->status = 0;
+			if(j->par) runTasks(jid);
+		}
+		else{ // WIFEXITED or WIFSIGNALED
+			int proc = slot->proc;
+			trace(TR_REAP, jid, pid, WIFEXITED(stat_loc) ? WEXITSTATUS(stat_loc) : 128 + WTERMSIG(stat_loc));
+			j->procs[proc].state = 2;
+			addUsage(&j->usage, &ru);
+			if(j->par) taskExited(jid, proc, stat_loc);
+			// a pipeline's status is the one of its last stage, unless that one failed to start
+			else if(proc == j->nprocs - 1 && j->exitstatus == -1){
+				j->exitstatus = WIFEXITED(stat_loc) ? WEXITSTATUS(stat_loc) : 128 + WTERMSIG(stat_loc);
+				j->termsig = WIFSIGNALED(stat_loc) ? WTERMSIG(stat_loc) : 0;
+			}
+			unindexpid(pid);
+			// the freed slot takes the next argument
+			if(j->par) runTasks(jid);
+			int alive = 0;
+			for(int i = 0; i < j->nprocs; i++) alive |= j->procs[i].state != 2;
+			if(alive) continue;
+			if(j->par){
+				// stopped with tasks left, they start once it is continued
+				if(j->par->next < j->par->nargs) continue;
+				parallelDone(jid);
+			}
 #if DEBUG_ENALBED
-	else printf("No foreground running job atm\n");
+			if(WIFEXITED(stat_loc)){
+				printf("Child process [%u] terminated normally with exit status %i\n", pid, WEXITSTATUS(stat_loc));
+			}
+			else{
+				printf("Child process [%u] terminated abnormally\n", pid);
+			}
 #endif
-	printf("\n"); // print a line feed to push prompt> into newline
+			// like timeout(1)
+			if(j->timedout) j->exitstatus = 124;
+			if(fgjid == jid){
+				laststatus = j->exitstatus;
+				recordfg(jid);
+			}
+			// parallel reported its tasks already
+			else if(!j->par) noticeJob(jid, 2);
+			resetjob(jid);
+		}
+	}
 }
 
-void SIGTSTPhandler(int signal){ // stop signal
-#if DEBUG_ENALBED
-	printf("caught SIGTSTP\n");
-#endif
-	// if there is a foreground job
+// forward a SIGINT or SIGTSTP typed at the terminal to the foreground job, the job is updated
+// by reapChildren once it actually terminates or stops
+void forwardSignal(int signal){
 	int fjid = getfjid();
 	if(fjid != -1){
-	// if(tcgetpgrp(fd) != currentpgid){
-		// sent SIGINT to all processes in the foreground
-		// if(killpg(tcgetpgrp(fd), SIGTSTP) != -1){
-			// send sigtstp, sigchld will be handled because
-			// of the child state change but will be ignored
-			jobs[fjid].terminated = 0;
-			jobs[fjid].status = 1;
-			kill(jobs[fjid].pid, SIGTSTP);
+		// sent to every process of the foreground job, whose pgid != parent process pgid. With
+		// job control the terminal sends them itself, the shell doesn't see them. A job in a
+		// cgroup is frozen instead of stopped
+		if(signal == SIGTSTP && freezeJob(fjid, 1)){
+			laststatus = 128 + SIGTSTP;
+			jobStopped(fjid);
+		}
+		else{
+			killpg(jobs[fjid].pid, signal);
+			trace(TR_SIGNAL, fjid, jobs[fjid].pid, signal);
+		}
+		if(signal == SIGINT) stats.sigint++;
+		else stats.sigtstp++;
 #if DEBUG_ENALBED
-			printf("jobs [%u] stopped\n", jobs[fjid].pid);
+		printf("signal [%i] sent to job [%u]\n", signal, jobs[fjid].pid);
 #endif
-		// }
-		// perror(NULL);
 	}
+	// a script is interrupted like any other program
+	else if(!interactive && signal == SIGINT) exit(128 + SIGINT);
+	// a builtin waiting is the foreground command, it can't be stopped as it is the shell
+	else if(inwait && signal == SIGINT) inwait = 2;
 #if DEBUG_ENALBED
 	else printf("No foreground running job atm\n");
 #endif
 	printf("\n"); // print a line feed to push prompt> into newline
+	// nothing was running, the line typed so far is discarded by the terminal
+	if(fjid == -1 && atprompt) printf("prompt> ");
 }
 
-// wait for foreground job jid to finish. Also handle special cases such as SIGTSTP
-void waitfgjob(int jid){
-	// if(newPgidSetsFgroup(fd, jobs[jid].pid) != -1){
-	// set the pgid of the child to its pid instead of keeping the inherinted
-	// process gid to prevent reciveing forground signal from the current process (tcgetpgrp == currentpgid)
-	jobs[jid].status = 2;
-	jobs[jid].terminated = 1;
-	setpgid(jobs[jid].pid, jobs[jid].pid);
-	int stat_loc;
-#if DEBUG_ENABLED
-	printf("waiting to reap child process [%u]\n", jobs[jid].pid);
-#endif
-	int wpid = waitpid(jobs[jid].pid, &stat_loc, 0);
-	// wpid can't be 0 because option = 0
-	if(wpid != -1 && wpid){
-		// Make sure that the job is terminated in case the terminating status is changed
-		// when waiting (due to ctrl-z)
-		// Can't termiate in SIGCHLDhandler because waitpid in that function will return 0
-		// due to WNOHANG and because the job is already reaped by waitpid in this
-		// function
-
-		// TODO: DOUBLE PROMPT> KILL or CTRL-z FOREGROUND PROCESS, disable disfunction diable that ?
-		if(jobs[jid].terminated) resetjob(jid);
-
-#if DEBUG_ENABLED
-		printf("child reaped\n");
-		// if(tcsetpgrp(fd, currentpgid) == -1) perror(NULL);
-		if(WIFEXITED(stat_loc)){
-			printf("Child process [%u] terminated normally with exit status %i\n", jobs[jid].pid, WEXITSTATUS(stat_loc));
-		}
-		else{
-			printf("Child process [%u] terminated abnormally\n", jobs[jid].pid);
+// read every pending signal from the signalfd, then reap the children once for all SIGCHLDs
+void handleSignals(){
+	struct signalfd_siginfo info;
+	int chld = 0;
+	while(read(sigfd, &info, sizeof info) == sizeof info){
+		switch(info.ssi_signo){
+			case SIGCHLD: chld = 1; break;
+			case SIGINT: // -- DROP DOWN --
+			case SIGTSTP: forwardSignal(info.ssi_signo); break;
 		}
-#endif
 	}
-	// wpid == -1
-#if DEBUG_ENALBED
-	else perror(NULL);
-#endif
-	// }
-	// else perror(NULL);
-#if DEBUG_ENABLED
-	else printf("invalid jid [%i] (waitfgjob)", jid);
-#endif
+	if(chld){
+		reapChildren();
+		// the slots of the jobs that terminated
+		admitJobs();
+	}
 }
 
-void processBuiltInJobs(){
-	for(int i = 0; i < MAX_JOB; i++){
-		if(jobs[i].pid != -1){
-			const char *status;
-			switch(jobs[i].status){
-				case 0: status = "Running"; break;
-				case 1: status = "Stopped"; break; // background running
-				default: status = "Unknown"; break;
-			}
-			printf("[%u] (%u) %s %s\n", i + 1, jobs[i].pid, status, jobs[i].cmd);
-		}
+double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void closeMeter(struct meter *m){
+	if(m->in == -1) return;
+	// closing removes them from epoll
+	close(m->in);
+	close(m->out);
+	m->in = m->out = -1;
+	m->end = now();
+	if(m->jid == fgjid){
+		double t = m->end - m->start;
+		printf("[%i] |: %lld bytes in %.2f s (%.1f MB/s)\n", m->jid + 1, m->bytes, t, t > 0 ? m->bytes / t / 1e6 : 0);
 	}
 }
 
-void processBuiltInQuit(){
-	// reap child processes in jobs
-	for(int i = 0; i < MAX_JOB; i++){
-		if(jobs[i].pid != -1){
-			// trival, the program would exit and 'jobs' is not going to be used
-			/* jobs[i].terminated = 1; */
-			kill(jobs[i].pid, SIGINT);
-		}
+/* Add a meter splicing in into out for job jid, return 0 if failed */
+int addMeter(int jid, int in, int out){
+	int id = 0;
+	while(id < nmeters && meters[id].jid != -1) id++;
+	if(id == nmeters){
+		struct meter *m = realloc(meters, (nmeters + 1) * sizeof *meters);
+		if(!m) return 0;
+		meters = m;
+		nmeters++;
 	}
+	fcntl(in, F_SETFL, O_NONBLOCK);
+	fcntl(out, F_SETFL, O_NONBLOCK);
+	meters[id] = (struct meter){ in, out, jid, 0, 0, now(), 0 };
+	struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_METER_IN, id) } };
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, in, &ev) == -1){
+		closeMeter(meters + id);
+		meters[id].jid = -1;
+		return 0;
+	}
+	return 1;
 }
 
-void processBuiltInCd(){
-	if(chdir(argv[1]) == -1){
-#if DEBUG_ENABLED
-		perror(NULL);
-#endif
+// move what the writing stage produced to the reading stage, without copying it to userspace
+void pumpMeter(struct meter *m){
+	while(1){
+		ssize_t n = splice(m->in, NULL, m->out, NULL, METER_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(n > 0){
+			m->bytes += n;
+			continue;
+		}
+		if(n == -1 && errno == EAGAIN){
+			int avail = 0;
+			ioctl(m->in, FIONREAD, &avail);
+			// in still has data, so out is full: the reading stage is the slower one, stop
+			// polling in until out has room
+			if(avail > 0 && !m->blocked){
+				struct epoll_event ev = { EPOLLOUT, { .u64 = EVENT(EV_METER_OUT, m - meters) } };
+				m->blocked = 1;
+				epoll_ctl(epfd, EPOLL_CTL_ADD, m->out, &ev);
+				ev = (struct epoll_event){ 0, { .u64 = EVENT(EV_METER_IN, m - meters) } };
+				epoll_ctl(epfd, EPOLL_CTL_MOD, m->in, &ev);
+			}
+			return;
+		}
+		// end of input (the writing stage closed its end) or EPIPE (the reading stage exited)
+		closeMeter(m);
+		return;
 	}
 }
 
-// print invalid command if applicable (return 0 if invalid, 1 if valid)
-void processBuiltInFg(int jid){
-	// send continue signal, ignored if already running
-	kill(jobs[jid].pid, SIGCONT);
-	// TODO: could it possible that tcgetpgrp() != currentpgid
-	// newPgidSetsFgroup(fd, jobs[jid].pid);
-	waitfgjob(jid);
-#if DEBUG_ENALBED
-	for(int i = 0; i < MAX_JOB; i++){
-		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
-		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [term:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].terminated, jobs[i].cmd);
+/* Return a capture ring of capturesize bytes for job jid, NULL if it can't be created */
+struct capture *newCapture(int jid){
+	struct capture *c = malloc(sizeof *c);
+	int fds[2];
+	if(!c) return NULL;
+	*c = (struct capture){ -1, -1, -1, NULL, capturesize, 0, -1 };
+	c->memfd = memfd_create("hw2-output", MFD_CLOEXEC);
+	// the pages are only allocated once written
+	if(c->memfd == -1 || ftruncate(c->memfd, c->size) == -1 || pipe2(fds, O_CLOEXEC) == -1){
+		freeCapture(c);
+		return NULL;
 	}
-#endif
+	c->rd = fds[0];
+	c->wr = fds[1];
+	if((c->map = mmap(NULL, c->size, PROT_READ, MAP_SHARED, c->memfd, 0)) == MAP_FAILED){
+		c->map = NULL;
+		freeCapture(c);
+		return NULL;
+	}
+	// the job's end stays blocking
+	fcntl(c->rd, F_SETFL, O_NONBLOCK);
+	struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_CAPTURE, jid) } };
+	epoll_ctl(epfd, EPOLL_CTL_ADD, c->rd, &ev);
+	return c;
 }
 
-void processBuiltInBg(int jid){
-	// send continue signal
-	jobs[jid].status = 0;
-	jobs[jid].terminated = 1;
-	kill(jobs[jid].pid, SIGCONT);
-#if DEBUG_ENALBED
-	for(int i = 0; i < MAX_JOB; i++){
-		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
-		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [term:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].terminated, jobs[i].cmd);
+void freeCapture(struct capture *c){
+	if(!c) return;
+	if(c->rd != -1) close(c->rd);
+	if(c->wr != -1) close(c->wr);
+	if(c->map) munmap(c->map, c->size);
+	if(c->memfd != -1) close(c->memfd);
+	free(c);
+}
+
+// write the captured bytes from position from on to fd, the ones still in the ring
+void printCapture(struct capture *c, unsigned long long from, int fd){
+	if(c->len > c->size && from < c->len - c->size) from = c->len - c->size;
+	while(from < c->len){
+		off_t off = from % c->size;
+		size_t n = c->len - from;
+		if(n > c->size - off) n = c->size - off;
+		ssize_t w = sendfile(fd, c->memfd, &off, n);
+		if(w <= 0) w = write(fd, c->map + from % c->size, n);
+		if(w <= 0) return;
+		from += w;
 	}
-#endif
 }
 
-void processBuiltInKill(int jid){
-	jobs[jid].terminated = 1;
-	// TODO: some child can ignore sigint ? change to sigkill
-	kill(jobs[jid].pid, SIGKILL);
-	resetjob(jid);
-#if DEBUG_ENALBED
-	for(int i = 0; i < MAX_JOB; i++){
-		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
-		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [term:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].terminated, jobs[i].cmd);
+/* Return the position of the last lines lines in the ring */
+unsigned long long tailCapture(struct capture *c, int lines){
+	unsigned long long start = c->len > c->size ? c->len - c->size : 0, pos = c->len;
+	if(!lines) return pos;
+	// the \n ending the last line doesn't start one
+	if(pos > start && c->map[(pos - 1) % c->size] == '\n') pos--;
+	for(; pos > start; pos--){
+		if(c->map[(pos - 1) % c->size] == '\n' && !--lines) break;
 	}
-#endif
+	return pos;
 }
 
-int processGeneralFg(){
-	int jid = lowestAvailJID();
-	if(jid == -1){
-		printf("No Job ID left to be used (max %u job(s))\n", MAX_JOB);
+// splice what the job wrote from the pipe into the ring, the data doesn't go through the
+// shell's memory. The pipe is closed at end of file
+void pumpCapture(struct capture *c){
+	while(c->rd != -1){
+		loff_t off = c->len % c->size;
+		ssize_t n = splice(c->rd, NULL, c->memfd, &off, c->size - off, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(n == -1 && errno == EAGAIN) return;
+		if(n <= 0){
+			// closing removes it from epoll
+			close(c->rd);
+			c->rd = -1;
+			return;
+		}
+		c->len += n;
+		if(c->follow != -1) printCapture(c, c->len - n, c->follow);
 	}
-	else{
-		strcpy(jobs[jid].cmd, cmdbuffer_unaltered);
-		int pid = fork();
-		if(pid == -1){
-#if DEBUG_ENABLED
-			perror(NULL);
-#endif
+}
+
+/* Arm the deadline of job jid to seconds from now (0: disarm), return 0 if failed */
+int armTimeout(int jid, double seconds){
+	struct job *j = jobs + jid;
+	if(j->timerfd == -1){
+		if(!seconds) return 1;
+		struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_TIMEOUT, jid) } };
+		j->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(j->timerfd == -1) return 0;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, j->timerfd, &ev) == -1){
+			close(j->timerfd);
+			j->timerfd = -1;
+			return 0;
 		}
-		else if(!pid){ // child process
-			// if(newPgidSetsFgroup(fd, jobs[jid].pid) != -1){
-				// set the pgid of the child to itself instead of keeping the inherinted
-				// process gid to prevent reciveing forground signal from the current process (tcgetpgrp == currentpgid)
-				setpgid(0, 0);
-				if(execv(argv[0], argv) == -1 && execvp(argv[0], argv) == -1){
-					perror("Unknown or invalid command");
-					exit(EXIT_FAILURE);
-				}
-			// }
+	}
+	long long ns = seconds * 1e9;
+	struct itimerspec t = { { 0, 0 }, { ns / 1000000000, ns % 1000000000 } };
+	return timerfd_settime(j->timerfd, 0, &t, NULL) != -1;
+}
+
+// the deadline of job jid passed: SIGTERM to the group, then SIGKILL once the grace period ends
+void expireJob(int jid){
+	struct job *j = jobs + jid;
+	read(j->timerfd, &(uint64_t){ 0 }, sizeof(uint64_t));
+	if(j->pid <= 0 || j->timedout == 2) return;
+	int sig = j->timedout ? SIGKILL : SIGTERM;
+	// the tasks of parallel not started yet are dropped
+	if(j->par) j->par->next = j->par->nargs;
+	killpg(j->pid, sig);
+	trace(TR_SIGNAL, jid, j->pid, sig);
+	// a stopped job can't handle SIGTERM
+	if(sig == SIGTERM && j->status == 1) killpg(j->pid, SIGCONT);
+	if(!j->timedout++) armTimeout(jid, j->grace);
+}
+
+/* Wait for the next events of the shell and handle them, return 1 if stdin is readable */
+// input == 0 while a foreground job runs, the shell doesn't read its input then
+int waitEvents(int input){
+	struct epoll_event events[MAX_EVENTS];
+	int ready = 0;
+	fflush(stdout);
+	if(input){
+		if(!stdinpollable){
+			// a regular file is always readable, only pick up the signals
+			handleSignals();
+			return 1;
 		}
-		else{ // current process
-			jobs[jid].pid = pid;
-			waitfgjob(jid);
+		// oneshot: stdin stays quiet while a foreground job owns the input
+		struct epoll_event ev = { EPOLLIN | EPOLLONESHOT, { .u64 = EVENT(EV_STDIN, 0) } };
+		epoll_ctl(epfd, EPOLL_CTL_MOD, STDIN_FILENO, &ev);
+	}
+	// the zygotes are forked once nothing is ready, not while a command line or a foreground job
+	// waits for the shell
+	int n = epoll_wait(epfd, events, MAX_EVENTS, 0);
+	if(!n && input && fgjid == -1 && nzygotes < zygotepool){
+		refillZygotes();
+		n = epoll_wait(epfd, events, MAX_EVENTS, 0);
+	}
+	if(!n) n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+	for(int i = 0; i < n; i++){
+		uint32_t id = events[i].data.u64;
+		switch(events[i].data.u64 >> 32){
+			case EV_STDIN: ready = 1; break;
+			case EV_SIGNAL: handleSignals(); break;
+			case EV_METER_IN: pumpMeter(meters + id); break;
+			case EV_TIMEOUT: expireJob(id); break;
+			case EV_STATS:
+				read(statsfd, &(uint64_t){ 0 }, sizeof(uint64_t));
+				writeStats();
+				break;
+			case EV_CAPTURE: if(jobs[id].cap) pumpCapture(jobs[id].cap); break;
+			case EV_SLEEP:
+				read(sleepfd, &(uint64_t){ 0 }, sizeof(uint64_t));
+				if(inwait == 1) inwait = 0;
+				break;
+			case EV_QUEUE: // time to check the load again
+				read(queuefd, &(uint64_t){ 0 }, sizeof(uint64_t));
+				admitJobs();
+				break;
+			case EV_NOTIFY: // end of the batch window
+				read(notifyfd, &(uint64_t){ 0 }, sizeof(uint64_t));
+				notifyarmed = 0;
+				if(atprompt && notifynow) flushNotices();
+				break;
+			case EV_METER_OUT: // the reading stage drained out, resume from in
+				meters[id].blocked = 0;
+				epoll_ctl(epfd, EPOLL_CTL_DEL, meters[id].out, NULL);
+				events[i].events = EPOLLIN;
+				events[i].data.u64 = EVENT(EV_METER_IN, id);
+				epoll_ctl(epfd, EPOLL_CTL_MOD, meters[id].in, events + i);
+				pumpMeter(meters + id);
+				break;
 		}
-		return 1;
 	}
-#if DEBUG_ENALBED
-	for(int i = 0; i < MAX_JOB; i++){
-		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
-		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [term:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].terminated, jobs[i].cmd);
+	if(atprompt && notifynow && !notifywindow) flushNotices();
+	return ready && input;
+}
+
+/* Set up the event loop, return -1 if failed */
+int initEvents(){
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTSTP);
+	if(sigprocmask(SIG_BLOCK, &mask, NULL) == -1) return -1;
+	// a meter whose reading stage exited gets EPIPE instead, reset for the children
+	signal(SIGPIPE, SIG_IGN);
+	if((sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) return -1;
+	if((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) return -1;
+	struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_SIGNAL, 0) } };
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) == -1) return -1;
+	ev = (struct epoll_event){ 0, { .u64 = EVENT(EV_STDIN, 0) } };
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == -1){
+		if(errno != EPERM) return -1;
+		stdinpollable = 0;
 	}
-#endif
 	return 0;
 }
 
-int processGeneralBg(){
-	int jid = lowestAvailJID();
-#if DEBUG_ENABLED
-	printf("bg job\n");
-#endif
-	if(jid == -1){
-		printf("No Job ID left to be used (max %u job(s))\n", MAX_JOB);
-	}
-	else{
-		strcpy(jobs[jid].cmd, cmdbuffer_unaltered);
-		jobs[jid].status = 0;
-		jobs[jid].terminated = 1;
-		jobs[jid].pid = fork();
-		if(jobs[jid].pid == -1){
-#if DEBUG_ENABLED
-			perror(NULL);
-#endif
-		}
-		else if(!jobs[jid].pid){ // child process
-			// set the pgid of the child to itself instead of keeping the inherinted
-			// process gid to prevent reciveing forground signal from the current process (tcgetpgrp == currentpgid)
-			setpgid(0, 0);
-			if(execv(argv[0], argv) == -1 && execvp(argv[0], argv) == -1){
-#if DEBUG_ENABLED
-				perror(NULL);
-#endif
-				exit(EXIT_FAILURE);
-			}
-		}
-		else{ // parent process
-			// set the pgid of the child to itself instead of keeping the inherinted
-			// process gid to prevent reciveing forground signal from the current process (tcgetpgrp == currentpgid)
-			setpgid(jobs[jid].pid, jobs[jid].pid);
+/* Parse a cpu list such as 0-3,8 into set, return 0 if invalid or empty */
+int parseCpus(const char *list, cpu_set_t *set){
+	CPU_ZERO(set);
+	while(*list){
+		char *end;
+		long first = strtol(list, &end, 10), last = first;
+		if(end == list || first < 0) return 0;
+		if(*end == '-'){
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if(end == list || last < first) return 0;
 		}
-		// dont wait for the child process, only handle its signal
-#if DEBUG_ENALBED
-	for(int i = 0; i < MAX_JOB; i++){
-		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
-		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [term:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].terminated, jobs[i].cmd);
+		if(last >= CPU_SETSIZE) return 0;
+		for(long c = first; c <= last; c++) CPU_SET(c, set);
+		list = end;
+		if(*list == ',' && list[1]) list++;
+		else if(*list) return 0;
 	}
-#endif
-		return 1;
+	return CPU_COUNT(set) > 0;
+}
+
+// print set as a cpu list to f, the ranges folded
+void printCpus(FILE *f, const cpu_set_t *set){
+	const char *sep = "";
+	for(int c = 0; c < CPU_SETSIZE; c++){
+		if(!CPU_ISSET(c, set)) continue;
+		int last = c;
+		while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) last++;
+		if(last == c) fprintf(f, "%s%i", sep, c);
+		else fprintf(f, "%s%i-%i", sep, c, last);
+		sep = ",";
+		c = last;
 	}
-	return 0;
 }
 
-void redirectIO(int argc){
-	// argv is empty or not is checked at the beginning of parseCmd
-	mode_t mode = S_IRWXU | S_IRWXG | S_IRWXO;
-	// the lowest i such that *argv[i] == <, >, or >>
-	int redirect_start = -1;
-	for(int i = 0; i < argc; i++){
-		if(!strcmp(argv[i], ">")){
-			// argv[i - 1] > argv[i + 1], argv[i - 1] is a program and argv[i + 1] is a file
-			if(i + 1 < argc && argv[i + 1]){
-				/* Output redirected to argv[i + 1] (Create or Write) */
-				int outFileID = open(argv[i + 1], O_CREAT|O_WRONLY|O_TRUNC, mode);
-				dup2(outFileID, STDOUT_FILENO);
-				// close unused fd
-				close(outFileID);
-				if(redirect_start == -1) redirect_start = i;
-			}
-		}
-		else if(!strcmp(argv[i], "<")){
-			// argv[i - 1] < argv[i + 1], argv[i - 1] is a program and argv[i + 1] is a file
-			if(i + 1 < argc && argv[i + 1]){
-				/* Input redirected to argv[i + 1] (Read) */
-				int inFileID = open(argv[i + 1], O_RDONLY, mode);
-				dup2(inFileID, STDIN_FILENO);
-				// close unused fd
-				close(inFileID);
-				if(redirect_start == -1) redirect_start = i;
-			}
-		}
-		else if(!strcmp(argv[i], ">>")){
-			// argv[i - 1] >> argv[i + 1], argv[i - 1] is a program and argv[i + 1] is a file
-			if(i + 1 < argc && argv[i + 1]){
-				/* Output appended to argv[i + 1] (Create or Append) */
-				// add write option, and remove truncate for appending to file to work properly
-				int outFileID = open(argv[i + 1], O_CREAT|O_WRONLY|O_APPEND, mode);
-				dup2(outFileID, STDOUT_FILENO);
-				// close unused fd
-				close(outFileID);
-				if(redirect_start == -1) redirect_start = i;
-			}
+/* Return the number of NUMA nodes, their cpus are read once */
+int numaNodes(){
+	if(nnodes != -1) return nnodes;
+	char path[64], list[4096];
+	cpu_set_t online;
+	nnodes = 0;
+	FILE *f = fopen("/sys/devices/system/node/online", "r");
+	// the node numbers are listed like cpus
+	if(!f) return 0;
+	int ok = fgets(list, sizeof list, f) && (list[strcspn(list, "\n")] = 0, parseCpus(list, &online));
+	fclose(f);
+	if(!ok) return 0;
+	int n = 0;
+	for(int i = 0; i < 64; i++) if(CPU_ISSET(i, &online)) n = i + 1;
+	if(!(nodecpus = calloc(n, sizeof *nodecpus))) return 0;
+	for(int i = 0; i < n; i++){
+		snprintf(path, sizeof path, "/sys/devices/system/node/node%i/cpulist", i);
+		if(!CPU_ISSET(i, &online) || !(f = fopen(path, "r"))) continue;
+		if(fgets(list, sizeof list, f)){
+			list[strcspn(list, "\n")] = 0;
+			parseCpus(list, nodecpus + i);
 		}
+		fclose(f);
 	}
-	if(redirect_start != -1){
-		// only parse the cmd and its argument and the argument where the redirection symbol starts
-		// > test.txt echo "hello" works in bash but this is a simple shell
-		argv[redirect_start] = NULL;
+	return nnodes = n;
+}
+
+/* Return the mask of the NUMA nodes of cpus, 0 without NUMA */
+unsigned long nodesOf(const cpu_set_t *cpus){
+	unsigned long nodes = 0;
+	if(numaNodes() < 2) return 0;
+	for(int i = 0; i < nnodes; i++){
+		cpu_set_t both;
+		CPU_AND(&both, nodecpus + i, cpus);
+		if(CPU_COUNT(&both)) nodes |= 1UL << i;
 	}
+	return nodes;
 }
 
-int parseCmd(int argc){
-	if(*argv){
-		redirectIO(argc); // redirect stdin (<), stdout (>) or append (>>)
-		if(!strcmp(*argv, "jobs")){ // builtin commands
-			if(argc == 1) processBuiltInJobs();
-			else return 0;
-		}
-		else if(!strcmp(*argv, "quit")){
-			if(argc == 1){
-				processBuiltInQuit();
-				return -1;
-			} 
-			else return 0;
-		}
-		else if(!strcmp(*argv, "cd")){
-			// check if path is valid
-			if(argc == 2) processBuiltInCd();
-			else return 0;
-		}
-		else if(!strcmp(*argv, "fg")){
-			int jid = getcmdjid();
-			if(jid != -1 && (jobs[jid].status == 0 || jobs[jid].status == 1)) processBuiltInFg(jid);
-			else return 0;
-		}
-		else if(!strcmp(*argv, "bg")){
-			int jid = getcmdjid();
-			if(jid != -1 && jobs[jid].status == 1) processBuiltInBg(jid);
-			else return 0;
-		}
-		else if(!strcmp(*argv, "kill")){
-			int jid = getcmdjid();
-			if(jid != -1) processBuiltInKill(jid);
-			else return 0;
-		}
-		else if(argv[argc-1][0] == '&'){ // possible general background
-			// don't include the argv[i] = '&' since it can be an invalid argument (such
-			// as sleep 500 &)
-			argv[argc-1] = NULL;
-			return processGeneralBg();
+// launch the next processes on cpus and their nodes' memory, NULL back to the shell's own
+// placement. A child inherits both at spawn, no fork is needed to set them
+void placeLaunch(const cpu_set_t *cpus){
+	sched_setaffinity(0, sizeof(cpu_set_t), cpus ? cpus : &shellcpus);
+	unsigned long nodes = cpus ? nodesOf(cpus) : 0;
+	if(nodes) syscall(SYS_set_mempolicy, MPOL_BIND, &nodes, 64);
+	else if(numaNodes() > 1) syscall(SYS_set_mempolicy, shellmempolicy, &shellnodes, 64);
+}
+
+/* Return the next pinwidth cpus of the shell's in turn for an & job under pin auto, NULL if off */
+cpu_set_t *autoPin(){
+	int n = CPU_COUNT(&shellcpus);
+	cpu_set_t *set;
+	if(!pinwidth || !n || !(set = malloc(sizeof *set))) return NULL;
+	CPU_ZERO(set);
+	for(int k = 0; k < pinwidth && k < n; k++){
+		// the idx-th cpu of the shell's
+		int idx = (pinnext + k) % n, c = 0;
+		for(; !CPU_ISSET(c, &shellcpus) || idx--; c++);
+		CPU_SET(c, set);
+	}
+	pinnext = (pinnext + pinwidth) % n;
+	return set;
+}
+
+/* Move every process of group pgid, with its threads, to cpus and its memory to their nodes.
+ * Return the number of threads that couldn't be moved */
+// there is no call for a whole group, /proc is scanned for its processes, including the ones
+// the job forked itself
+int pinGroup(int pgid, const cpu_set_t *cpus){
+	unsigned long nodes = nodesOf(cpus), all = ~0UL;
+	char path[64], line[256];
+	int failed = 0;
+	DIR *proc = opendir("/proc");
+	if(!proc) return 1;
+	struct dirent *d;
+	while((d = readdir(proc))){
+		int pid = atoi(d->d_name), pgrp = 0;
+		if(pid <= 0) continue;
+		snprintf(path, sizeof path, "/proc/%i/stat", pid);
+		FILE *f = fopen(path, "r");
+		if(!f) continue;
+		// state, ppid then pgrp follow the command name
+		if(fgets(line, sizeof line, f) && strrchr(line, ')')) sscanf(strrchr(line, ')') + 2, "%*c %*d %d", &pgrp);
+		fclose(f);
+		if(pgrp != pgid) continue;
+		snprintf(path, sizeof path, "/proc/%i/task", pid);
+		DIR *tasks = opendir(path);
+		struct dirent *t;
+		while(tasks && (t = readdir(tasks))){
+			int tid = atoi(t->d_name);
+			if(tid > 0 && sched_setaffinity(tid, sizeof(cpu_set_t), cpus) == -1) failed++;
 		}
-		else {
-			return processGeneralFg();
+		if(tasks) closedir(tasks);
+		// what it allocates from now on isn't bound, its policy is its own
+		if(nodes) syscall(SYS_migrate_pages, pid, 64, &all, &nodes);
+	}
+	closedir(proc);
+	return failed;
+}
+
+/* Write s to file name of cgroup directory dir, return 0 if failed */
+int cgWrite(int dir, const char *name, const char *s){
+	int fd = openat(dir, name, O_WRONLY | O_CLOEXEC);
+	if(fd == -1) return 0;
+	int ok = write(fd, s, strlen(s)) == (ssize_t)strlen(s);
+	close(fd);
+	return ok;
+}
+
+/* Return the value of key in file name of cgroup directory dir (its first word if key is NULL),
+ * -1 if unknown or "max" */
+long long cgRead(int dir, const char *name, const char *key){
+	char buf[1024];
+	long long value = -1;
+	int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return -1;
+	ssize_t n = read(fd, buf, sizeof buf - 1);
+	close(fd);
+	if(n <= 0) return -1;
+	buf[n] = 0;
+	char *at = key ? strstr(buf, key) : buf;
+	if(at) sscanf(at + (key ? strlen(key) : 0), "%lld", &value);
+	return value;
+}
+
+/* Set up the shell's cgroup subtree, return 0 if there is no cgroup v2 hierarchy it can write */
+// the shell moves itself to a leaf of the subtree: a cgroup whose controllers are enabled for
+// its children can't have processes of its own
+int initCgroups(){
+	char line[4096], mnt[4096] = "", path[4096] = "", dir[8192 + 32];
+	FILE *f = fopen("/proc/self/mountinfo", "r");
+	if(!f) return 0;
+	// the mount point is the 5th field, a hybrid host has it at /sys/fs/cgroup/unified
+	while(!*mnt && fgets(line, sizeof line, f)){
+		if(strstr(line, " - cgroup2 ")) sscanf(line, "%*s %*s %*s %*s %4095s", mnt);
+	}
+	fclose(f);
+	if(!(f = fopen("/proc/self/cgroup", "r"))) return 0;
+	while(!*path && fgets(line, sizeof line, f)){
+		line[strcspn(line, "\n")] = 0;
+		if(!strncmp(line, "0::", 3)) strcpy(path, line + 3);
+	}
+	fclose(f);
+	if(!*mnt || !*path) return 0;
+	snprintf(dir, sizeof dir, "%s%s", mnt, strcmp(path, "/") ? path : "");
+	int base = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(base == -1) return 0;
+	snprintf(dir, sizeof dir, "hw2.%i", getpid());
+	int root = -1;
+	if((mkdirat(base, dir, 0755) == -1 && errno != EEXIST) || (root = openat(base, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1){
+		close(base);
+		return 0;
+	}
+	mkdirat(root, "shell", 0755);
+	cgprocsfd = openat(root, "shell/cgroup.procs", O_WRONLY | O_CLOEXEC);
+	if(cgprocsfd == -1 || write(cgprocsfd, "0", 1) != 1){
+		if(cgprocsfd != -1) close(cgprocsfd);
+		cgprocsfd = -1;
+		unlinkat(root, "shell", AT_REMOVEDIR);
+		unlinkat(base, dir, AT_REMOVEDIR);
+		close(root);
+		close(base);
+		return 0;
+	}
+	// the controllers of the limits, where the parent already delegates them. Its own
+	// subtree_control is the user's, the shell only changes the ones of its subtree
+	const char *controllers[] = { "+memory", "+cpu" };
+	for(int i = 0; i < 2; i++) cgWrite(root, "cgroup.subtree_control", controllers[i]);
+	close(base);
+	cgroupfd = root;
+	return 1;
+}
+
+/* Return 1 if controller name is enabled for the jobs' cgroups */
+int cgController(const char *name){
+	char buf[256];
+	int fd = openat(cgroupfd, "cgroup.subtree_control", O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return 0;
+	ssize_t n = read(fd, buf, sizeof buf - 1);
+	close(fd);
+	if(n <= 0) return 0;
+	buf[n] = 0;
+	for(char *w = strtok(buf, " \n"); w; w = strtok(NULL, " \n")) if(!strcmp(w, name)) return 1;
+	return 0;
+}
+
+// give job jid a cgroup of its own with the limits of cgroup, it runs without one if that fails
+void newCgroup(int jid){
+	char name[32];
+	snprintf(name, sizeof name, "job%lu", ++cgseq);
+	if(mkdirat(cgroupfd, name, 0755) == -1) return;
+	int fd = openat(cgroupfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1){
+		unlinkat(cgroupfd, name, AT_REMOVEDIR);
+		return;
+	}
+	if(*cgmemmax) cgWrite(fd, "memory.max", cgmemmax);
+	if(*cgcpumax) cgWrite(fd, "cpu.max", cgcpumax);
+	jobs[jid].cgroup = fd;
+	jobs[jid].cgid = cgseq;
+}
+
+/* Remove the cgroups of the jobs that are gone (all: of every job), return the number of them
+ * that still have processes */
+// such as the ones of a killed job, until they exit
+int removeCgroups(int all){
+	int left = 0;
+	int fd = cgroupfd == -1 ? -1 : dup(cgroupfd);
+	DIR *dir = fd == -1 ? NULL : fdopendir(fd);
+	if(!dir){
+		if(fd != -1) close(fd);
+		return 0;
+	}
+	// the copy shares the offset of cgroupfd, where the last sweep ended
+	rewinddir(dir);
+	struct dirent *d;
+	while((d = readdir(dir))){
+		unsigned long id;
+		if(sscanf(d->d_name, "job%lu", &id) != 1) continue;
+		int used = 0;
+		for(int i = 0; i < njobslots && !all; i++) used |= jobs[i].cgroup != -1 && jobs[i].cgid == id;
+		if(!used && unlinkat(cgroupfd, d->d_name, AT_REMOVEDIR) == -1) left++;
+	}
+	closedir(dir);
+	return left;
+}
+
+// remove the cgroups of the jobs that are gone, the ones still busy by a later call
+void sweepCgroups(){
+	removeCgroups(0);
+}
+
+// launch the next processes into the cgroup of job jid, -1 back to the shell's. A child starts
+// in the cgroup of its parent, it can't fork before it is in the job's
+void cgroupLaunch(int jid){
+	int fd = jid == -1 ? cgprocsfd : openat(jobs[jid].cgroup, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+	if(fd == -1) return;
+	write(fd, "0", 1);
+	if(jid != -1) close(fd);
+}
+
+/* Freeze (or thaw) the cgroup of job jid, return 0 if it has none */
+// all of its processes at once, including the ones that ignore SIGTSTP or left its group
+int freezeJob(int jid, int freeze){
+	struct job *j = jobs + jid;
+	if(j->cgroup == -1 || !cgWrite(j->cgroup, "cgroup.freeze", freeze ? "1" : "0")) return 0;
+	for(int i = 0; i < j->nprocs; i++) if(j->procs[i].state != 2) j->procs[i].state = freeze;
+	trace(TR_SIGNAL, jid, j->pid, freeze ? SIGSTOP : SIGCONT);
+	return 1;
+}
+
+// move the shell back to where it started and remove its subtree, once it quits. interrupted:
+// quit sent SIGINT to the jobs, their cgroups go too once they exited. The jobs a script leaves
+// running keep theirs and the subtree
+void closeCgroups(int interrupted){
+	if(cgroupfd == -1) return;
+	char name[32];
+	int base = openat(cgroupfd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(base == -1) return;
+	cgWrite(base, "cgroup.procs", "0");
+	unlinkat(cgroupfd, "shell", AT_REMOVEDIR);
+	// the processes that were just killed or interrupted take a moment to exit. A child not
+	// reaped yet keeps its cgroup too. One ignoring SIGINT past the wait keeps the subtree
+	double deadline = now() + CGROUP_EXIT_WAIT;
+	while(1){
+		while(waitpid(-1, NULL, WNOHANG) > 0);
+		if(!removeCgroups(interrupted) || now() > deadline) break;
+		usleep(10000);
+	}
+	snprintf(name, sizeof name, "hw2.%i", getpid());
+	unlinkat(base, name, AT_REMOVEDIR);
+	close(base);
+}
+
+/* Return 1 if the stages of job jid are launched into the foreground of the terminal */
+int takesTerminal(int jid){
+	return ttyfd != -1 && (jid == fglaunch || jid == fgjid);
+}
+
+// hand the terminal to job jid with the modes it had when it stopped. Done before it is
+// continued, a job in the background that touches the terminal is stopped by SIGTTIN or SIGTTOU
+void giveTerminal(int jid){
+	if(ttyfd == -1) return;
+	if(jobs[jid].tmodes) tcsetattr(ttyfd, TCSADRAIN, jobs[jid].tmodes);
+	tcsetpgrp(ttyfd, jobs[jid].pid);
+}
+
+// take the terminal back from job jid once it stopped or ended, with the shell's modes
+void takeTerminal(int jid){
+	if(ttyfd == -1) return;
+	tcsetpgrp(ttyfd, shellpgid);
+	// a stopped job gets its modes back on fg, such as an editor's raw mode
+	if(jobs[jid].pid != -1 && jobs[jid].status == 1){
+		if(!jobs[jid].tmodes) jobs[jid].tmodes = malloc(sizeof *jobs[jid].tmodes);
+		if(jobs[jid].tmodes) tcgetattr(ttyfd, jobs[jid].tmodes);
+	}
+	// the modes set by a command that exited, such as stty, are kept like bash does
+	if(jobs[jid].pid == -1 && laststatus < 128) tcgetattr(ttyfd, &shelltmodes);
+	else tcsetattr(ttyfd, TCSADRAIN, &shelltmodes);
+}
+
+// wait for foreground job jid to terminate or stop, in the foreground of the terminal
+// meanwhile. ^C and ^Z are forwarded to it if the shell has no terminal
+void waitfgjob(int jid){
+	jobs[jid].status = 2;
+	fgjid = jid;
+#if DEBUG_ENABLED
+	printf("waiting to reap child process [%u]\n", jobs[jid].pid);
+#endif
+	fgechoed = 0;
+	giveTerminal(jid);
+	while(fgjid == jid) waitEvents(0);
+	takeTerminal(jid);
+}
+
+/* Add the usage so far of running process pid to sum, return 0 if it is gone */
+// a child's rusage is only known once it is reaped, /proc has the figures of a live one
+int procUsage(int pid, struct rusage *sum){
+	char path[64], line[256];
+	struct rusage ru = { { 0 } };
+	unsigned long utime, stime;
+	long tick = sysconf(_SC_CLK_TCK);
+	snprintf(path, sizeof path, "/proc/%i/stat", pid);
+	FILE *f = fopen(path, "r");
+	if(!f) return 0;
+	// the fields after the command name, which can contain spaces, utime and stime are 12 and 13
+	int ok = fgets(line, sizeof line, f) && strrchr(line, ')') &&
+		sscanf(strrchr(line, ')') + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2;
+	fclose(f);
+	if(!ok) return 0;
+	ru.ru_utime = (struct timeval){ utime / tick, utime % tick * 1000000 / tick };
+	ru.ru_stime = (struct timeval){ stime / tick, stime % tick * 1000000 / tick };
+	snprintf(path, sizeof path, "/proc/%i/status", pid);
+	if((f = fopen(path, "r"))){
+		while(fgets(line, sizeof line, f)){
+			sscanf(line, "VmHWM: %ld", &ru.ru_maxrss);
+			sscanf(line, "voluntary_ctxt_switches: %ld", &ru.ru_nvcsw);
+			sscanf(line, "nonvoluntary_ctxt_switches: %ld", &ru.ru_nivcsw);
 		}
+		fclose(f);
 	}
+	addUsage(sum, &ru);
 	return 1;
 }
 
-// ps -a | grep hw2 | cut -d ' ' -f 2
+void printUsage(double wall, const struct rusage *ru){
+	fprintf(bout, "real %.3fs user %.3fs sys %.3fs maxrss %ld KB csw %ld vol %ld invol\n", wall,
+		ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6, ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6,
+		ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw);
+}
 
-// ctrl-c, ctrl-z will skip scanf, num_matched_char == -1
-// num_matched_char == 0 means entered '\n' into the prompt, otherwise num_matched_char > 0
-void cleanupIO(int argc, int num_matched_char){
-	// case 1: argc 0 and no value in input stream (ctrl-c, ctr-z)
-	// case 2: argc 0 and '\n' in input stream (press enter without cmd)
-	// num_matched_char can be EOF (see parseTokens)
-	if(num_matched_char != -1 && num_matched_char != EOF) while(getchar() != '\n');
-	for(int i = 0; i < MAX_LINE; i++){
-		if(cmdbuffer[i]) cmdbuffer[i] = 0;
-		if(cmdbuffer_unaltered[i]) cmdbuffer_unaltered[i] = 0;
-	}
-	for(int i = 0; i < argc; i++){
-		argv[i] = NULL;
+/* Builtins: return -1 to quit the shell, 0 if invalid, 1 otherwise. jid is the job named by
+ * argv[1] for the builtins taking a job, -1 for the others */
+int processBuiltInJobs(int argc, int jid){
+	int details = argc == 2; // jobs -l
+	if(details && strcmp(argv[1], "-l")) return 0;
+	for(int i = 0; i < njobslots; i++){
+		if(jobs[i].pid != -1){
+			const char *status;
+			switch(jobs[i].status){
+				case 0: status = "Running"; break;
+				case 1: status = "Stopped"; break; // background running
+				case 3: status = "Queued"; break;
+				default: status = "Unknown"; break;
+			}
+			fprintf(bout, "[%u] (%u) %s %s", i + 1, jobs[i].pid, status, jobs[i].cmd);
+			if(jobs[i].par){
+				struct parallel *p = jobs[i].par;
+				fprintf(bout, " [%i/%i done, %i running]", p->next - p->running, p->nargs, p->running);
+			}
+			if(jobs[i].queued) fprintf(bout, " [prio %i]", jobs[i].queued->prio);
+			if(jobs[i].cpus){
+				fprintf(bout, " [cpus ");
+				printCpus(bout, jobs[i].cpus);
+				unsigned long nodes = nodesOf(jobs[i].cpus);
+				if(nodes){
+					fprintf(bout, " nodes");
+					for(int n = 0; n < 64; n++) if(nodes >> n & 1) fprintf(bout, " %i", n);
+				}
+				fprintf(bout, "]");
+			}
+			if(jobs[i].cgroup != -1){
+				int cg = jobs[i].cgroup;
+				long long mem = cgRead(cg, "memory.current", NULL), memmax = cgRead(cg, "memory.max", NULL);
+				long long quota = cgRead(cg, "cpu.max", NULL), period = cgRead(cg, "cpu.max", " ");
+				fprintf(bout, " [cgroup cpu %.2fs", cgRead(cg, "cpu.stat", "usage_usec") / 1e6);
+				if(quota > 0 && period > 0) fprintf(bout, " max %.2f cpus", (double)quota / period);
+				if(mem >= 0) fprintf(bout, " mem %.1fM", mem / 1048576.0);
+				if(memmax >= 0) fprintf(bout, " max %.1fM", memmax / 1048576.0);
+				fprintf(bout, "]");
+			}
+			struct itimerspec t;
+			if(jobs[i].timerfd != -1 && !timerfd_gettime(jobs[i].timerfd, &t) && (t.it_value.tv_sec || t.it_value.tv_nsec)){
+				fprintf(bout, " [%s in %.1fs]", jobs[i].timedout ? "SIGKILL" : "timeout", t.it_value.tv_sec + t.it_value.tv_nsec / 1e9);
+			}
+			for(int m = 0; m < nmeters; m++){
+				if(meters[m].jid != i) continue;
+				double t = (meters[m].in == -1 ? meters[m].end : now()) - meters[m].start;
+				fprintf(bout, " [|: %lld bytes, %.1f MB/s]", meters[m].bytes, t > 0 ? meters[m].bytes / t / 1e6 : 0);
+			}
+			if(jobs[i].cap) fprintf(bout, " [output %llu bytes]", jobs[i].cap->len);
+			fprintf(bout, "\n");
+			if(details){
+				struct rusage ru = jobs[i].usage;
+				fprintf(bout, "    pids");
+				for(int k = 0; k < jobs[i].nprocs; k++){
+					if(jobs[i].procs[k].state == 2) continue;
+					fprintf(bout, " %i", jobs[i].procs[k].pid);
+					procUsage(jobs[i].procs[k].pid, &ru);
+				}
+				fprintf(bout, "\n    ");
+				printUsage(now() - jobs[i].start, &ru);
+			}
+		}
+	}
+	return 1;
+}
+
+int processBuiltInQuit(int argc, int jid){
+	// reap child processes in jobs
+	for(int i = 0; i < njobslots; i++){
+		if(jobs[i].pid > 0){ // not queued
+			// trival, the program would exit and 'jobs' is not going to be used
+			killpg(jobs[i].pid, SIGINT);
+			trace(TR_SIGNAL, i, jobs[i].pid, SIGINT);
+			// a frozen job gets it once thawed
+			freezeJob(i, 0);
+		}
 	}
+	if(interactive){
+		struct rusage self;
+		getrusage(RUSAGE_SELF, &self);
+		fprintf(bout, "session: %i jobs\n  jobs  ", njobsrun);
+		printUsage(now() - sessionstart, &sessionusage);
+		fprintf(bout, "  shell ");
+		printUsage(now() - sessionstart, &self);
+	}
+	if(statspath) writeStats();
+	return -1;
 }
 
-/* parse token, return -1 if failed, argc if success */
-// NOTE: CTRL-C, CTRL-Z WILL SKIP SCANF (num_matched_char = -1)
-int parseTokens(int *num_matched_char){
-	// prompt_printed is used to prevent prompt> to print twice incase of ctrl-z or kill in some situation
-	static int prompt_printed = 0;
-	size_t i = 0;
-	// if there is no foreground job
-	if(getfjid() == -1){
-	// if(tcgetpgrp(fd) == currentpgid){
-		if(!prompt_printed){
-			printf("prompt> ");
-			prompt_printed = 1;
-		}
-		if((*num_matched_char = scanf("%[^\n]", cmdbuffer_unaltered)) != EOF){
-			// num_matched_char == 0 means entered '\n' into the prompt, otherwise a
-			// potential command
-			if(num_matched_char){
-				strcpy(cmdbuffer, cmdbuffer_unaltered);
-				do{
-					argv[i] = strtok( i ? NULL : cmdbuffer, " \t\n");
-				} while(argv[i] && ++i < MAX_ARGC);
+int processBuiltInHash(int argc, int jid){
+	if(argc == 2){ // hash -r
+		if(strcmp(argv[1], "-r")) return 0;
+		flushPathCache();
+	}
+	else{
+		int empty = 1;
+		for(int i = 0; i < PATH_BUCKETS; i++){
+			for(struct pathent *e = pathcache[i]; e; e = e->next){
+				if(empty) fprintf(bout, "hits\tcommand\n");
+				fprintf(bout, "%4u\t%s\n", e->hits, e->path);
+				empty = 0;
 			}
 		}
-		else{
+		if(empty) fprintf(bout, "hash: hash table empty\n");
+	}
+	return 1;
+}
+
+int processBuiltInCd(int argc, int jid){
+	if(chdir(argv[1]) == -1){
+		laststatus = 1;
 #if DEBUG_ENABLED
-			perror(NULL);
+		perror(NULL);
 #endif
-			return -2;
-		}
+	}
+	return 1;
+}
+
+int processBuiltInFg(int argc, int jid){
+	// a queued job skips the queue
+	fglaunch = jid;
+	int launched = jobs[jid].status != 3 || launchQueued(jid);
+	fglaunch = -1;
+	if(!launched){
+		takeTerminal(jid);
+		return 1;
+	}
+	// the terminal first, then the continue signal, ignored if already running
+	giveTerminal(jid);
+	freezeJob(jid, 0);
+	killpg(jobs[jid].pid, SIGCONT);
+	trace(TR_SIGNAL, jid, jobs[jid].pid, SIGCONT);
+	jobs[jid].status = 2;
+	// the slots freed while it was stopped
+	if(jobs[jid].par && !resumeTasks(jid)) return 1;
+	// a captured job replays its output so far, then streams it while in the foreground
+	struct capture *c = jobs[jid].cap;
+	if(c){
+		fflush(stdout);
+		printCapture(c, 0, STDOUT_FILENO);
+		c->follow = STDOUT_FILENO;
+	}
+	waitfgjob(jid);
+	if(c) c->follow = -1;
+#if DEBUG_ENALBED
+	for(int i = 0; i < njobslots; i++){
+		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
+		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].cmd);
+	}
+#endif
+	return 1;
+}
+
+int processBuiltInBg(int argc, int jid){
+	// send continue signal
+	jobs[jid].status = 0;
+	freezeJob(jid, 0);
+	killpg(jobs[jid].pid, SIGCONT);
+	trace(TR_SIGNAL, jid, jobs[jid].pid, SIGCONT);
+	if(jobs[jid].par) resumeTasks(jid);
 #if DEBUG_ENALBED
-		printf("input cmd: %s\n", cmdbuffer_unaltered);
+	for(int i = 0; i < njobslots; i++){
+		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
+		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].cmd);
+	}
 #endif
+	return 1;
+}
+
+int processBuiltInKill(int argc, int jid){
+	// TODO: some child can ignore sigint ? change to sigkill
+	if(jobs[jid].pid > 0){ // a queued job is only taken out of the queue
+		// its cgroup, with the processes that left its group
+		if(jobs[jid].cgroup == -1 || !cgWrite(jobs[jid].cgroup, "cgroup.kill", "1")) killpg(jobs[jid].pid, SIGKILL);
+		trace(TR_SIGNAL, jid, jobs[jid].pid, SIGKILL);
 	}
+	// the pids are reaped later as unknown children
+	resetjob(jid);
 #if DEBUG_ENALBED
-	printf("there is a running foreground job, not parsing token\n");
+	for(int i = 0; i < njobslots; i++){
+		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
+		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].cmd);
+	}
 #endif
-	// during prompt> scanf, recieved signal will pop function this from the stack during scanf waiting for input so it is unlikely that it would reach here, only when scanf is sucess then prompt_printed is enabled.
-	prompt_printed = 0;
-	return i; // argc
-}
-
-int main(){
-	// tty fd
-	/* FILE *f = fopen(ctermid(NULL), "r"); */
-	/* fd = fileno(f); */
-	/* if(fd != -1){ */
-		int quit = 0;
-		// original copy of the stdin and stdout fd
-		int stdin_cpy = dup(STDIN_FILENO);
-		int stdout_cpy = dup(STDOUT_FILENO);
-		do{
-			// set the pgid of each spawned process to its own pid so the signal does not
-			// propagated to the child pid
-			/* signal(SIGTTOU, SIG_IGN); */
-			signal(SIGCHLD, SIGCHLDhandler);
-			signal(SIGINT, SIGINThandler);
-			signal(SIGTSTP, SIGTSTPhandler);
-			int num_matched_char = -1;
-			int argc = parseTokens(&num_matched_char);
-			if(argc){
-				int parse_ret = parseCmd(argc);
-				switch(parse_ret){
-					case -2: printf("Failed to parse command\n"); break;
-					case -1: quit = 1; break;
-					case 0: printf("Invalid command.\n"); break;
-					default: break; // failed or pass but cmd parsed
+	return 1;
+}
+
+/* Write the events kept in the ring to f, return the number written */
+// only the events of job jid (-1: all) whose kind is in the mask kinds, at most the last count
+// of them. chrome: as the Chrome trace event format (chrome://tracing, Perfetto), one track per job
+int dumpTrace(FILE *f, int jid, int kinds, int count, int chrome){
+	unsigned long head = atomic_load(&tracehead);
+	unsigned long first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+	if(first < tracestart) first = tracestart;
+	long long start = 0;
+	int written = 0, matched = 0;
+	for(int pass = 0; pass < 2; pass++){
+		for(unsigned long i = first; i < head; i++){
+			struct trace t = traces[i & (TRACE_EVENTS - 1)];
+			// overwritten or still being written
+			if(atomic_load_explicit(&traces[i & (TRACE_EVENTS - 1)].seq, memory_order_acquire) != i + 1) continue;
+			if(!start) start = t.ns;
+			if((jid != -1 && t.jid != jid) || !(kinds & 1 << t.kind)) continue;
+			// the first pass counts the matching events to skip all but the last count
+			if(!pass){
+				matched++;
+				continue;
+			}
+			if(matched-- > count) continue;
+			if(chrome){
+				fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%i,\"tid\":%i,\"args\":{\"pid\":%i,\"arg\":%i}}",
+					written ? "," : "", tracenames[t.kind], t.ns / 1e3, getpid(), t.jid + 1, t.pid, t.arg);
+			}
+			else{
+				fprintf(f, "%12.6f  %-8s [%i] %i", (t.ns - start) / 1e9, tracenames[t.kind], t.jid + 1, t.pid);
+				switch(t.kind){
+					case TR_FORK: // -- DROP DOWN --
+					case TR_SETPGID: fprintf(f, " pgid %i", t.arg); break;
+					case TR_SIGNAL: // -- DROP DOWN --
+					case TR_STOP: fprintf(f, " SIG%s", sigabbrev_np(t.arg)); break;
+					case TR_REAP: // -- DROP DOWN --
+					case TR_RESET: fprintf(f, " status %i", t.arg); break;
+				}
+				fprintf(f, "\n");
+			}
+			written++;
+		}
+	}
+	return written;
+}
+
+// notify [on | off] [-w ms]: job notices right away or before the next prompt only, batched
+// for ms. Without arguments, print the settings
+int processBuiltInNotify(int argc, int jid){
+	if(argc == 1){
+		fprintf(bout, "notify %s -w %i\n", notifynow ? "on" : "off", notifywindow);
+		return 1;
+	}
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "on")) notifynow = 1;
+		else if(!strcmp(argv[i], "off")) notifynow = 0;
+		else if(!strcmp(argv[i], "-w") && i + 1 < argc && atoi(argv[i + 1]) >= 0){
+			if(notifyfd == -1){
+				struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_NOTIFY, 0) } };
+				notifyfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+				if(notifyfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, notifyfd, &ev) == -1){
+					fprintf(berr, "notify: %s\n", strerror(errno));
+					laststatus = 1;
+					return 1;
 				}
 			}
-			cleanupIO(argc, num_matched_char);
-			// restore input output to stdin and stdout in case of redirectIO is called
-			dup2(stdin_cpy, STDIN_FILENO);
-			dup2(stdout_cpy, STDOUT_FILENO);
-		} while(!quit);
-	/* } */
+			notifywindow = atoi(argv[++i]);
+		}
+		else return 0;
+	}
+	return 1;
+}
+
+// trace [-c] [-n count] [%jid | event...] [--chrome file]
+int processBuiltInTrace(int argc, int jid){
+	int kinds = 0, count = TRACE_EVENTS, clear = 0;
+	const char *chrome = NULL;
+	jid = -1;
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "-c")) clear = 1;
+		else if(!strcmp(argv[i], "-n") && i + 1 < argc) count = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--chrome") && i + 1 < argc) chrome = argv[++i];
+		else if(argv[i][0] == '%') jid = atoi(argv[i] + 1) - 1;
+		else{
+			int kind = 0;
+			while(kind <= TR_RESET && strcmp(argv[i], tracenames[kind])) kind++;
+			if(kind > TR_RESET) return 0;
+			kinds |= 1 << kind;
+		}
+	}
+	if(!kinds) kinds = ~0;
+	if(clear) tracestart = atomic_load(&tracehead);
+	else if(chrome){
+		FILE *f = fopen(chrome, "w");
+		if(!f){
+			fprintf(berr, "%s: %s\n", chrome, strerror(errno));
+			laststatus = 1;
+			return 1;
+		}
+		fprintf(f, "{\"traceEvents\":[");
+		int n = dumpTrace(f, jid, kinds, count, 1);
+		fprintf(f, "\n]}\n");
+		fclose(f);
+		fprintf(bout, "%i events written to %s\n", n, chrome);
+	}
+	else dumpTrace(bout, jid, kinds, count, 0);
+	return 1;
+}
+
+// FNV-1a starting from seed instead of the usual offset basis
+unsigned hashseed(const char *s, unsigned seed){
+	unsigned h = seed;
+	while(*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+unsigned hashstr(const char *s){
+	return hashseed(s, 2166136261u);
+}
+
+// remove every resolved path, the directories are kept
+void flushPathCache(){
+	for(int i = 0; i < PATH_BUCKETS; i++){
+		while(pathcache[i]){
+			struct pathent *e = pathcache[i];
+			pathcache[i] = e->next;
+			free(e->name);
+			free(e->path);
+			free(e);
+		}
+	}
+}
+
+// split $PATH into pathdirs if it changed since the last call, flush the cache if so
+void loadPathDirs(){
+	const char *path = getenv("PATH");
+	if(!path) path = "/usr/local/bin:/usr/bin:/bin";
+	if(cachedPATH && !strcmp(cachedPATH, path)) return;
+	flushPathCache();
+	for(int i = 0; i < npathdirs; i++) free(pathdirs[i].dir);
+	free(cachedPATH);
+	cachedPATH = strdup(path);
+	npathdirs = 1;
+	for(const char *c = path; *c; c++) if(*c == ':') npathdirs++;
+	pathdirs = realloc(pathdirs, npathdirs * sizeof *pathdirs);
+	const char *begin = path;
+	for(int i = 0; i < npathdirs; i++){
+		size_t len = strcspn(begin, ":");
+		// an empty entry means the current directory
+		pathdirs[i].dir = len ? strndup(begin, len) : strdup(".");
+		pathdirs[i].mtime = (struct timespec){ 0, 0 };
+		begin += len + 1;
+	}
+}
+
+// stat the first n $PATH directories, return 1 if any was modified since the last check
+int pathDirsChanged(int n){
+	int changed = 0;
+	struct stat st;
+	for(int i = 0; i < n && i < npathdirs; i++){
+		if(stat(pathdirs[i].dir, &st) == -1) st.st_mtim = (struct timespec){ 0, 0 };
+		if(st.st_mtim.tv_sec != pathdirs[i].mtime.tv_sec || st.st_mtim.tv_nsec != pathdirs[i].mtime.tv_nsec){
+			pathdirs[i].mtime = st.st_mtim;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+/* Return the path argv[0] should be spawned from, NULL if it can't be found */
+// same lookup order as execv then execvp: argv[0] relative to the cwd first, then $PATH. $PATH
+// hits are cached so the child does a single execve instead of trying every directory
+const char *resolvecmd(const char *name){
+	struct stat st;
+	// a directory in the cwd named like the command doesn't shadow $PATH, execv fails on it too
+	if(strchr(name, '/') || (!access(name, X_OK) && !stat(name, &st) && S_ISREG(st.st_mode))) return name;
+	loadPathDirs();
+	struct pathent **bucket = pathcache + (hashstr(name) & (PATH_BUCKETS - 1));
+	struct pathent *e = *bucket;
+	while(e && strcmp(e->name, name)) e = e->next;
+	// a new file in an earlier directory or a removed file in its own directory changes the
+	// result, so only those directories have to be checked
+	if(pathDirsChanged(e ? e->dir + 1 : npathdirs)){
+		flushPathCache();
+		e = NULL;
+	}
+	if(e){
+		e->hits++;
+		return e->path;
+	}
+	// out of memory the lookup is done without caching, its result is kept until the next one
+	static char uncached[4096];
+	for(int i = 0; i < npathdirs; i++){
+		size_t len = strlen(pathdirs[i].dir) + strlen(name) + 2;
+		char *path = malloc(len), *buf = path ? path : len <= sizeof uncached ? uncached : NULL;
+		if(!buf) continue;
+		sprintf(buf, "%s/%s", pathdirs[i].dir, name);
+		if(!access(buf, X_OK) && !stat(buf, &st) && S_ISREG(st.st_mode)){
+			char *cmd = path ? strdup(name) : NULL;
+			if(cmd && (e = malloc(sizeof *e))){
+				*e = (struct pathent){ cmd, path, i, 1, *bucket };
+				*bucket = e;
+				return path;
+			}
+			free(cmd);
+			if(path){
+				snprintf(uncached, sizeof uncached, "%s", path);
+				free(path);
+			}
+			return len <= sizeof uncached ? uncached : NULL;
+		}
+		free(path);
+	}
+	return NULL;
+}
+
+/* dup2 the redirections of a stage into the calling process, return 0 if a file can't be
+ * opened. Only done by the child of the fork fallback, the shell's own fds are never touched */
+int applyRedirects(struct stage *st){
+	mode_t mode = S_IRWXU | S_IRWXG | S_IRWXO;
+	for(int i = 0; i < st->nredirs; i++){
+		struct redirect *r = st->redirs + i;
+		if(r->dupfd != -1){
+			dup2(r->dupfd, r->fd);
+			continue;
+		}
+		int fileID = open(r->path, r->flags, mode);
+		if(fileID == -1){
+			perror(r->path);
+			return 0;
+		}
+		dup2(fileID, r->fd);
+		// close unused fd
+		close(fileID);
+	}
+	return 1;
+}
+
+/* Open the redirections of a builtin into temporary fds and point bin, bout and berr at them,
+ * return 0 if a file can't be opened. closeBuiltInRedirects puts the previous ones back */
+// fds 0, 1 and 2 of the shell stay as they are, nothing has to be restored after the builtin
+int openBuiltInRedirects(struct stage *st, int *saved, FILE **savedout, FILE **savederr){
+	int fds[3] = { bin, fileno(bout), fileno(berr) };
+	int opened[3] = { -1, -1, -1 };
+	int ok = 1;
+	*saved = bin;
+	*savedout = bout;
+	*savederr = berr;
+	for(int i = 0; i < st->nredirs && ok; i++){
+		struct redirect *r = st->redirs + i;
+		if(r->fd > 2) continue; // no other fd is used by a builtin
+		if(r->dupfd != -1){
+			if(r->dupfd <= 2) fds[r->fd] = fds[r->dupfd];
+			continue;
+		}
+		if(opened[r->fd] != -1) close(opened[r->fd]);
+		opened[r->fd] = fds[r->fd] = open(r->path, r->flags | O_CLOEXEC, S_IRWXU | S_IRWXG | S_IRWXO);
+		if(fds[r->fd] == -1){
+			fprintf(berr, "%s: %s\n", r->path, strerror(errno));
+			ok = 0;
+		}
+	}
+	if(ok){
+		// every stream gets its own fd, for &> stdout and stderr are the same file
+		if(fds[0] != bin) bin = fcntl(fds[0], F_DUPFD_CLOEXEC, 0);
+		if(fds[1] != fileno(bout)) bout = fdopen(fcntl(fds[1], F_DUPFD_CLOEXEC, 0), "w");
+		if(fds[2] != fileno(berr)) berr = fdopen(fcntl(fds[2], F_DUPFD_CLOEXEC, 0), "w");
+		if(!bout || !berr || bin == -1) ok = 0;
+	}
+	for(int i = 0; i < 3; i++){
+		if(opened[i] != -1) close(opened[i]);
+	}
+	return ok;
+}
+
+void closeBuiltInRedirects(int saved, FILE *savedout, FILE *savederr){
+	if(bin != saved && bin != -1) close(bin);
+	if(bout != savedout && bout) fclose(bout);
+	if(berr != savederr && berr) fclose(berr);
+	bin = saved;
+	bout = savedout;
+	berr = savederr;
+}
+
+// fork fallback for what posix_spawn can't express, such as an executable file without a #!
+// line (ENOEXEC) which execvp runs through /bin/sh but posix_spawn doesn't
+int forkjob(struct stage *st, int jid, int pgid){
+	int pid = fork();
+	if(!pid){ // child process
+		// set the pgid of the child to itself (or to the pipeline's) instead of keeping the inherinted
+		// process gid to prevent reciveing forground signal from the current process (tcgetpgrp == currentpgid)
+		setpgid(0, pgid);
+		// before the shell does, the program could read the terminal first. SIGTTOU is ignored
+		if(takesTerminal(jid)) tcsetpgrp(ttyfd, getpgrp());
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		signal(SIGPIPE, SIG_DFL);
+		signal(SIGTTOU, SIG_DFL);
+		if(st->in != -1) dup2(st->in, STDIN_FILENO);
+		if(st->out != -1) dup2(st->out, STDOUT_FILENO);
+		if(st->err != -1) dup2(st->err, STDERR_FILENO);
+		if(!applyRedirects(st)) exit(EXIT_FAILURE);
+		if(execv(st->argv[0], st->argv) == -1 && execvp(st->argv[0], st->argv) == -1){
+			perror("Unknown or invalid command");
+			exit(EXIT_FAILURE);
+		}
+	}
 #if DEBUG_ENABLED
-	else perror(NULL);
+	else if(pid == -1) perror(NULL);
+#endif
+	// the exec happens later in the child, which can't record in the shell's ring
+	if(pid > 0){
+		trace(TR_FORK, jid, pid, pgid ? pgid : pid);
+		stats.forks++;
+	}
+	return pid;
+}
+
+// a zygote waits for one command and execs it, or exits once the shell closed its socket
+void zygoteMain(int sock){
+	static char buf[ZYGOTE_MESSAGE];
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	struct zygotecmd cmd;
+	int fds[3];
+	// closed by the exec, the EOF tells the shell it succeeded
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+	struct iovec iov = { buf, sizeof buf };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof control };
+	ssize_t n = recvmsg(sock, &msg, 0);
+	struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+	if(n < (ssize_t)sizeof cmd || !c || c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(sizeof fds)) _exit(EXIT_SUCCESS);
+	memcpy(&cmd, buf, sizeof cmd);
+	memcpy(fds, CMSG_DATA(c), sizeof fds);
+	char **args = malloc((cmd.argc + cmd.envc + 2) * sizeof *args), **env = args + cmd.argc + 1;
+	char *s = buf + sizeof cmd, *path = s;
+	s += strlen(s) + 1;
+	char *cwd = s;
+	s += strlen(s) + 1;
+	for(int i = 0; i < cmd.argc + cmd.envc + 1; i++){
+		if(i == cmd.argc) continue;
+		args[i] = s;
+		s += strlen(s) + 1;
+	}
+	args[cmd.argc] = env[cmd.envc] = NULL;
+	if(cmd.pgid) setpgid(0, cmd.pgid);
+	// 0 is still the shell's terminal, SIGTTOU is ignored like in the shell
+	if(cmd.tty) tcsetpgrp(STDIN_FILENO, getpgrp());
+	// the received fds are all above 2, 0 to 2 are still open
+	for(int i = 0; i < 3; i++) dup2(fds[i], i);
+	for(int i = 0; i < 3; i++) close(fds[i]);
+	chdir(cwd);
+	// setting SIG_IGN drops what is pending, such as a ^C typed before the setpgid above
+	int sigs[] = { SIGCHLD, SIGINT, SIGTSTP, SIGPIPE, SIGTTOU };
+	for(int i = 0; i < 5; i++){
+		signal(sigs[i], SIG_IGN);
+		signal(sigs[i], SIG_DFL);
+	}
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+	execve(path, args, env);
+	// the socket is closed by the exec, the shell reads errno instead if it failed
+	int err = errno;
+	write(sock, &err, sizeof err);
+	_exit(127);
+}
+
+// start zygotes until zygotepool of them are idle. Called while the shell waits, so that a
+// launch doesn't pay for it
+void refillZygotes(){
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t actions;
+	char *zygoteargv[] = { "hw2", "--zygote", NULL };
+	while(nzygotes < zygotepool){
+		int sv[2], pid, err;
+		if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) return;
+		// in a group of its own, so the ^C and ^Z the shell gets don't reach it while idle. It
+		// keeps the shell's signal mask until it runs a command
+		posix_spawnattr_init(&attr);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, sv[1], ZYGOTE_FD);
+		err = posix_spawn(&pid, "/proc/self/exe", &actions, &attr, zygoteargv, environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attr);
+		close(sv[1]);
+		if(err){
+			close(sv[0]);
+			return;
+		}
+		zygotes[nzygotes++] = (struct zygote){ pid, sv[0] };
+	}
+}
+
+/* Append s to the zygote command msg of len bytes, return its new length or 0 if too long */
+size_t packZygoteCmd(char *msg, size_t len, const char *s){
+	size_t n = strlen(s) + 1;
+	if(!len || len + n > ZYGOTE_MESSAGE) return 0;
+	memcpy(msg + len, s, n);
+	return len + n;
+}
+
+/* Launch a stage of job jid like spawnjob with an idle zygote, return its pid, -1 if failed or
+ * 0 if no zygote could take it */
+int zygotejob(struct stage *st, int jid, int pgid){
+	static char msg[ZYGOTE_MESSAGE];
+	char control[CMSG_SPACE(3 * sizeof(int))] = { 0 };
+	char cwd[MAX_PATH];
+	int fds[3] = { st->in != -1 ? st->in : STDIN_FILENO, st->out != -1 ? st->out : STDOUT_FILENO, st->err != -1 ? st->err : STDERR_FILENO };
+	int opened[3], nopened = 0;
+	const char *path = resolvecmd(st->argv[0]);
+	// spawnjob reports a missing command
+	if(!path || !getcwd(cwd, sizeof cwd)) return 0;
+	struct zygotecmd cmd = { pgid, 0, 0, takesTerminal(jid) };
+	size_t len = packZygoteCmd(msg, sizeof cmd, path);
+	len = packZygoteCmd(msg, len, cwd);
+	// argv ends at its NULL, the stages of parallel tasks have no argc
+	for(char **a = st->argv; *a; a++, cmd.argc++) len = packZygoteCmd(msg, len, *a);
+	for(char **e = environ; *e; e++, cmd.envc++) len = packZygoteCmd(msg, len, *e);
+	if(!len) return 0;
+	memcpy(msg, &cmd, sizeof cmd);
+	// the shell opens the files of the redirections, only the standard streams are passed
+	for(int i = 0; i < st->nredirs; i++){
+		struct redirect *r = st->redirs + i;
+		if(r->fd > 2 || r->dupfd > 2){
+			while(nopened) close(opened[--nopened]);
+			return 0;
+		}
+		if(r->dupfd != -1){
+			fds[r->fd] = fds[r->dupfd];
+			continue;
+		}
+		int fd = open(r->path, r->flags | O_CLOEXEC, S_IRWXU | S_IRWXG | S_IRWXO);
+		if(fd == -1){
+			perror("Failed to redirect");
+			laststatus = 1;
+			while(nopened) close(opened[--nopened]);
+			return -1;
+		}
+		fds[r->fd] = opened[nopened++] = fd;
+	}
+	struct iovec iov = { msg, len };
+	struct msghdr m = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof control };
+	struct cmsghdr *c = CMSG_FIRSTHDR(&m);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof fds);
+	memcpy(CMSG_DATA(c), fds, sizeof fds);
+	struct zygote z = { 0, -1 };
+	while(nzygotes){
+		z = zygotes[--nzygotes];
+		if(sendmsg(z.sock, &m, 0) != -1) break;
+		// the zygote is gone, it was killed while idle
+		close(z.sock);
+		z.pid = 0;
+	}
+	while(nopened) close(opened[--nopened]);
+	if(!z.pid) return 0;
+	// EOF once it exec'd, like posix_spawn returns
+	int err = 0;
+	read(z.sock, &err, sizeof err);
+	close(z.sock);
+	if(err == ENOEXEC) return forkjob(st, jid, pgid);
+	if(err){
+		errno = err;
+		perror("Unknown or invalid command");
+		laststatus = err == ENOENT ? 127 : 126;
+		return -1;
+	}
+	zygotelaunches++;
+	// the zygote forked the child, which then joined the group and exec'd
+	trace(TR_FORK, jid, z.pid, pgid ? pgid : z.pid);
+	trace(TR_SETPGID, jid, z.pid, pgid ? pgid : z.pid);
+	trace(TR_EXEC, jid, z.pid, 0);
+	return z.pid;
+}
+
+/* Launch a stage of job jid in process group pgid (0: a new one), return its pid or -1 if
+ * failed */
+// posix_spawn creates the child with vfork semantics (CLONE_VM|CLONE_VFORK), the shell's page
+// tables are not copied on every launch like fork() does. setpgid, the pipes and the
+// redirections are done in the child through the spawn attributes and file actions
+int spawnjob(struct stage *st, int jid, int pgid){
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t actions;
+	sigset_t mask;
+	pid_t pid;
+	int err;
+	// a zygote has its own placement and cgroup, a pinned job, a parallel --pin task or one in a
+	// cgroup is spawned from the shell
+	int pinned = jobs[jid].cpus || (jobs[jid].par && jobs[jid].par->ncpus);
+	if(nzygotes && !pinned && jobs[jid].cgroup == -1 && (pid = zygotejob(st, jid, pgid))) return pid;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setpgroup(&attr, pgid);
+	// the shell blocks the signals it reads from the signalfd, don't pass them on
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	// SIGPIPE and SIGTTOU are ignored by the shell
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGTTOU);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+	posix_spawn_file_actions_init(&actions);
+	// the child joins the foreground itself, before the dup2s replace the terminal on ttyfd.
+	// The shell does it too once it launched, whichever comes first
+	if(takesTerminal(jid)) posix_spawn_file_actions_addtcsetpgrp_np(&actions, ttyfd);
+	if(st->in != -1) posix_spawn_file_actions_adddup2(&actions, st->in, STDIN_FILENO);
+	if(st->out != -1) posix_spawn_file_actions_adddup2(&actions, st->out, STDOUT_FILENO);
+	if(st->err != -1) posix_spawn_file_actions_adddup2(&actions, st->err, STDERR_FILENO);
+	for(int i = 0; i < st->nredirs; i++){
+		struct redirect *r = st->redirs + i;
+		if(r->dupfd != -1) posix_spawn_file_actions_adddup2(&actions, r->dupfd, r->fd);
+		else posix_spawn_file_actions_addopen(&actions, r->fd, r->path, r->flags, S_IRWXU | S_IRWXG | S_IRWXO);
+	}
+	const char *path = resolvecmd(st->argv[0]);
+	err = path ? posix_spawn(&pid, path, &actions, &attr, st->argv, environ) : ENOENT;
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if(err == ENOEXEC) return forkjob(st, jid, pgid);
+	if(err){
+		errno = err;
+		// the command is there, opening one of the files of the redirections failed
+		if(path && st->nredirs && !access(path, X_OK)){
+			perror("Failed to redirect");
+			laststatus = 1;
+			return -1;
+		}
+		perror("Unknown or invalid command");
+		laststatus = err == ENOENT ? 127 : 126;
+		return -1;
+	}
+	// posix_spawn returns once the child it cloned exec'd, after its setpgid
+	trace(TR_FORK, jid, pid, pgid ? pgid : pid);
+	trace(TR_SETPGID, jid, pid, pgid ? pgid : pid);
+	trace(TR_EXEC, jid, pid, 0);
+	stats.spawns++;
+	return pid;
+}
+
+/* Launch every stage of the pipeline as job jid, return 0 if no process could be started */
+// all the stages share the process group of the first one, so the job is signaled as a whole
+int launchjob(int jid){
+	int pgid = 0;
+	int in = -1; // read end of the pipe from the previous stage
+	// taken now, the meters refer to it
+	setjobpid(jid, 0);
+	struct capture *cap = jobs[jid].cap;
+	if(jobs[jid].cpus) placeLaunch(jobs[jid].cpus);
+	if(jobs[jid].cgroup != -1) cgroupLaunch(jid);
+	for(int i = 0; i < nstages; i++){
+		int fds[2] = { -1, -1 };
+		int next = -1;
+		stages[i].in = in;
+		stages[i].out = cap && i == nstages - 1 ? cap->wr : -1;
+		stages[i].err = cap ? cap->wr : -1;
+		if(i < nstages - 1 && pipe2(fds, O_CLOEXEC) != -1){
+			stages[i].out = fds[1];
+			next = fds[0];
+			int m[2];
+			if(stages[i].metered && pipe2(m, O_CLOEXEC) != -1){
+				// the shell splices fds[0] into m[1], the next stage reads m[0]
+				if(addMeter(jid, fds[0], m[1])) next = m[0];
+				else close(m[0]);
+			}
+		}
+		double start = now();
+		int pid = spawnjob(stages + i, jid, pgid);
+		recordLaunch(start, pid);
+		if(i == nstages - 1) jobs[jid].exitstatus = pid == -1 ? laststatus : -1;
+		// the child has its own copy
+		if(in != -1) close(in);
+		if(i < nstages - 1 && stages[i].out != -1) close(stages[i].out);
+		in = next;
+		// a stage that failed to start is skipped, its neighbours see end of file or EPIPE
+		if(pid == -1) continue;
+		if(!pgid) pgid = jobs[jid].pid = pid;
+		addjobproc(jid, pid);
+	}
+	if(jobs[jid].cpus) placeLaunch(NULL);
+	if(jobs[jid].cgroup != -1) cgroupLaunch(-1);
+	// the children have their copies, the pipe ends once they exit
+	if(cap){
+		close(cap->wr);
+		cap->wr = -1;
+	}
+	if(!pgid) resetjob(jid);
+	else if(jobs[jid].timeout) armTimeout(jid, jobs[jid].timeout);
+	return pgid != 0;
+}
+
+int processGeneralFg(){
+	int jid = lowestAvailJID();
+	if(jid == -1){
+		printf("No Job ID left to be used\n");
+	}
+	else{
+		fglaunch = jid;
+		int launched = launchjob(jid);
+		fglaunch = -1;
+		if(launched){
+			setJobCmd(jid);
+			waitfgjob(jid);
+		}
+		// a stage that failed to exec could have taken it already
+		else takeTerminal(jid);
+		return 1;
+	}
+#if DEBUG_ENALBED
+	for(int i = 0; i < njobslots; i++){
+		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
+		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].cmd);
+	}
 #endif
 	return 0;
 }
 
+/* Return the value of key in /proc file path, -1 if it can't be read */
+// /proc/loadavg has no keys, its first field is read then
+double readProcValue(const char *path, const char *key){
+	char buf[256];
+	double value = -1;
+	FILE *f = fopen(path, "r");
+	if(!f) return -1;
+	size_t n = fread(buf, 1, sizeof buf - 1, f);
+	fclose(f);
+	buf[n] = 0;
+	char *at = key ? strstr(buf, key) : buf;
+	if(at) sscanf(at + (key ? strlen(key) : 0), "%lf", &value);
+	return value;
+}
+
+/* Return 1 if one more background job can be started now */
+int admissible(){
+	int running = 0;
+	if(limitjobs){
+		for(int i = 0; i < njobslots; i++) running += jobs[i].pid > 0 && (jobs[i].status == 0 || jobs[i].status == 2);
+		if(running >= limitjobs) return 0;
+	}
+	// PSI: share of the last 10 s some task waited for a cpu
+	if(limitload && readProcValue("/proc/loadavg", NULL) >= limitload) return 0;
+	if(limitpsi && readProcValue("/proc/pressure/cpu", "some avg10=") >= limitpsi) return 0;
+	return 1;
+}
+
+/* Copy the stages of the parsed command into a queued entry of job jid, return 0 if failed */
+// the words and the file names are copied too, argv is reused by the next command line
+int queueJob(int jid, int prio){
+	size_t size = sizeof(struct queued) + nstages * sizeof(struct stage);
+	for(int i = 0; i < nstages; i++){
+		size += (stages[i].argc + 1) * sizeof(char *) + stages[i].nredirs * sizeof(struct redirect);
+		for(int a = 0; a < stages[i].argc; a++) size += strlen(stages[i].argv[a]) + 1;
+		for(int r = 0; r < stages[i].nredirs; r++){
+			if(stages[i].redirs[r].path) size += strlen(stages[i].redirs[r].path) + 1;
+		}
+	}
+	struct queued *q = malloc(size);
+	if(!q) return 0;
+	*q = (struct queued){ prio, queueseq++, nstages, (struct stage *)(q + 1) };
+	// the stages, then for each one its argv and redirs, then the strings
+	char **ptrs = (char **)(q->stages + nstages);
+	for(int i = 0; i < nstages; i++){
+		q->stages[i] = stages[i];
+		q->stages[i].argv = ptrs;
+		ptrs += stages[i].argc + 1;
+		q->stages[i].redirs = (struct redirect *)ptrs;
+		ptrs = (char **)(q->stages[i].redirs + stages[i].nredirs);
+	}
+	char *str = (char *)ptrs;
+	for(int i = 0; i < nstages; i++){
+		for(int a = 0; a < stages[i].argc; a++){
+			q->stages[i].argv[a] = str;
+			str = stpcpy(str, stages[i].argv[a]) + 1;
+		}
+		q->stages[i].argv[stages[i].argc] = NULL;
+		for(int r = 0; r < stages[i].nredirs; r++){
+			q->stages[i].redirs[r] = stages[i].redirs[r];
+			if(!stages[i].redirs[r].path) continue;
+			q->stages[i].redirs[r].path = str;
+			str = stpcpy(str, stages[i].redirs[r].path) + 1;
+		}
+	}
+	setjobpid(jid, 0);
+	jobs[jid].queued = q;
+	jobs[jid].status = 3;
+	setJobCmd(jid);
+	laststatus = 0;
+	return 1;
+}
+
+/* Start queued job jid, return 0 if it couldn't be started (and was reset) */
+int launchQueued(int jid){
+	struct queued *q = jobs[jid].queued;
+	struct stage *saved = stages;
+	int nsaved = nstages;
+	int status = laststatus; // a job failing to start doesn't change the shell's status
+	jobs[jid].queued = NULL;
+	jobs[jid].status = 0;
+	// launchjob starts the parsed stages
+	stages = q->stages;
+	nstages = q->nstages;
+	int ok = launchjob(jid);
+	stages = saved;
+	nstages = nsaved;
+	free(q);
+	laststatus = status;
+	return ok;
+}
+
+// start the queued jobs while admissible, by priority then in order
+void admitJobs(){
+	while(1){
+		int best = -1;
+		for(int i = 0; i < njobslots; i++){
+			if(jobs[i].status != 3) continue;
+			if(best == -1 || jobs[i].queued->prio > jobs[best].queued->prio ||
+				(jobs[i].queued->prio == jobs[best].queued->prio && jobs[i].queued->seq < jobs[best].queued->seq)) best = i;
+		}
+		if(best == -1) return;
+		if(!admissible()){
+			// the load can go down without any job terminating, look again in a second
+			if((limitload || limitpsi) && queuefd != -1){
+				struct itimerspec t = { { 0, 0 }, { 1, 0 } };
+				timerfd_settime(queuefd, 0, &t, NULL);
+			}
+			return;
+		}
+		launchQueued(best);
+	}
+}
+
+int processGeneralBg(){
+	int jid = lowestAvailJID();
+#if DEBUG_ENABLED
+	printf("bg job\n");
+#endif
+	if(jid == -1){
+		printf("No Job ID left to be used\n");
+	}
+	else{
+		capturenext = captureon;
+		if(!nextpin) nextpin = autoPin();
+		// past the limit, the job waits for one to terminate
+		if(!admissible()) queueJob(jid, 0);
+		else if(launchjob(jid)){
+			setJobCmd(jid);
+			jobs[jid].status = 0;
+			laststatus = 0;
+		}
+		// dont wait for the child process, only handle its signal
+#if DEBUG_ENALBED
+	for(int i = 0; i < njobslots; i++){
+		if(i == 0) printf("current pgid: %i\n", getpgid(getpid()));
+		printf("job [jid:%i] [pid:%i] [pgid:%i] [stat:%i] [%s]\n", i + 1, jobs[i].pid, getpgid(jobs[i].pid), jobs[i].status, jobs[i].cmd);
+	}
+#endif
+		return 1;
+	}
+	return 0;
+}
+
+void freeParallel(struct parallel *p){
+	if(p->in != -1) close(p->in);
+	if(p->out != -1) close(p->out);
+	free(p->strings);
+	free(p->tmpl);
+	free(p->slottask);
+	free(p->proctask);
+	free(p->exits);
+	free(p->cpus);
+	free(p);
+}
+
+// record the exit status of the task run by process proc of parallel job jid and free its slot
+void taskExited(int jid, int proc, int stat_loc){
+	struct parallel *p = jobs[jid].par;
+	int task = p->proctask[proc];
+	p->exits[task] = WIFEXITED(stat_loc) ? WEXITSTATUS(stat_loc) : 128 + WTERMSIG(stat_loc);
+	if(p->exits[task]) p->failed++;
+	// ^C stops the whole run, not only the tasks running at the time
+	if(WIFSIGNALED(stat_loc) && WTERMSIG(stat_loc) == SIGINT) p->next = p->nargs;
+	for(int i = 0; i < p->njobs; i++){
+		if(p->slottask[i] == task) p->slottask[i] = -1;
+	}
+	p->running--;
+}
+
+/* Return the argv of the task running arg, NULL if out of memory */
+// every {} of the template is replaced by arg, arg is appended if there is none
+char **taskArgv(struct parallel *p, const char *arg){
+	size_t arglen = strlen(arg), size = 0;
+	int found = 0;
+	for(int i = 0; i < p->ntmpl; i++){
+		size += strlen(p->tmpl[i]) + 1;
+		for(const char *c = p->tmpl[i]; (c = strstr(c, "{}")); c += 2, found++) size += arglen;
+	}
+	if(!found) size += arglen + 1;
+	// the pointers and the words in one block
+	char **targv = malloc((p->ntmpl + 2) * sizeof *targv + size);
+	if(!targv) return NULL;
+	char *out = (char *)(targv + p->ntmpl + 2);
+	for(int i = 0; i < p->ntmpl; i++){
+		targv[i] = out;
+		for(const char *c = p->tmpl[i]; *c; ){
+			if(c[0] == '{' && c[1] == '}'){
+				out = memcpy(out, arg, arglen) + arglen;
+				c += 2;
+			}
+			else *out++ = *c++;
+		}
+		*out++ = 0;
+	}
+	targv[p->ntmpl] = found ? NULL : strcpy(out, arg);
+	targv[p->ntmpl + 1] = NULL;
+	return targv;
+}
+
+// start the next arguments of parallel job jid in its free slots, unless it is stopped
+void runTasks(int jid){
+	struct job *j = jobs + jid;
+	struct parallel *p = j->par;
+	int status = laststatus; // a task failing to start doesn't change the shell's status
+	for(int slot = 0; slot < p->njobs && p->next < p->nargs && j->status != 1; slot++){
+		if(p->slottask[slot] != -1) continue;
+		int task = p->next++;
+		char **targv = taskArgv(p, p->args[task]);
+		if(!targv){
+			p->next = p->nargs;
+			break;
+		}
+		struct stage st = { targv, 0, NULL, 0, p->in, p->out, 0, -1 };
+		cpu_set_t cpu;
+		if(p->ncpus){
+			CPU_ZERO(&cpu);
+			CPU_SET(p->cpus[slot % p->ncpus], &cpu);
+			placeLaunch(&cpu);
+		}
+		else if(j->cpus) placeLaunch(j->cpus);
+		if(j->cgroup != -1) cgroupLaunch(jid);
+		// the tasks share the process group of the job while one of them is alive
+		double start = now();
+		int pid = spawnjob(&st, jid, p->running ? j->pid : 0);
+		recordLaunch(start, pid);
+		if(p->ncpus || j->cpus) placeLaunch(NULL);
+		if(j->cgroup != -1) cgroupLaunch(-1);
+		free(targv);
+		if(pid == -1){
+			p->exits[task] = laststatus;
+			p->failed++;
+			slot--; // retry the slot with the next argument
+			continue;
+		}
+		if(!p->running++) j->pid = pid;
+		p->proctask[j->nprocs] = task;
+		p->slottask[slot] = task;
+		addjobproc(jid, pid);
+	}
+	laststatus = status;
+}
+
+/* Start the tasks of parallel job jid that can run, return 0 if the job is done (and reset) */
+int resumeTasks(int jid){
+	struct parallel *p = jobs[jid].par;
+	runTasks(jid);
+	if(p->running || p->next < p->nargs) return 1;
+	// none of the remaining tasks could start
+	parallelDone(jid);
+	if(fgjid == jid || jobs[jid].status == 2){
+		laststatus = jobs[jid].exitstatus;
+		recordfg(jid);
+	}
+	resetjob(jid);
+	return 0;
+}
+
+// report the exit status of every task of parallel job jid, which terminated
+void parallelDone(int jid){
+	struct parallel *p = jobs[jid].par;
+	int interrupted = 0;
+	notice("[%i] parallel: %i of %i tasks failed\n", jid + 1, p->failed, p->nargs);
+	for(int i = 0; i < p->nargs; i++){
+		if(p->exits[i] == -1){ // not run because of ^C or a timeout
+			interrupted = 1;
+			notice("   -\t%s\n", p->args[i]);
+		}
+		else notice("%4i\t%s\n", p->exits[i], p->args[i]);
+	}
+	// like GNU parallel: the number of failed tasks, at most 101
+	jobs[jid].exitstatus = interrupted ? 128 + SIGINT : p->failed > 101 ? 101 : p->failed;
+	// the report of a foreground run or of a script is part of its output
+	if(jobs[jid].status == 2 || !interactive) flushNotices();
+}
+
+int processBuiltInParallel(int argc, int jid){
+	struct parallel *p = calloc(1, sizeof *p);
+	int i, ok = 0;
+	if(!p) return 0;
+	p->in = p->out = -1;
+	// one task per cpu the job may run on by default, the shell's unless pinned
+	cpu_set_t cpus = nextpin ? *nextpin : shellcpus;
+	p->njobs = CPU_COUNT(&cpus);
+	for(i = 1; i < argc && argv[i][0] == '-' && !argquoted[i]; i++){
+		if(!strcmp(argv[i], "-j") && i + 1 < argc) p->njobs = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--pin")) p->ncpus = CPU_COUNT(&cpus);
+		else goto done;
+	}
+	int sep = i; // :::, the arguments follow the template
+	while(sep < argc && !isop(argv + sep, ":::")) sep++;
+	p->ntmpl = sep - i;
+	// without :::, one argument per line of stdin, which must be redirected from a file
+	int fromstdin = 0;
+	for(int r = 0; r < stages->nredirs; r++) fromstdin |= stages->redirs[r].fd == STDIN_FILENO;
+	if(p->njobs < 1 || !p->ntmpl || (sep == argc && !fromstdin)) goto done;
+	// the template words and the arguments in one block
+	size_t size = INPUT_BUFFER, len = 0;
+	int nstrings = 0;
+	for(int w = i; w < argc; w++) size += strlen(argv[w]) + 1;
+	if(!(p->strings = malloc(size))) goto done;
+	for(int w = i; w < argc; w++){
+		if(w == sep) continue;
+		len = stpcpy(p->strings + len, argv[w]) - p->strings + 1;
+		nstrings++;
+	}
+	if(sep == argc){
+		size_t lines = len, out = len, start = len;
+		ssize_t n;
+		do{
+			if(size - len < INPUT_BUFFER){
+				char *newstrings = realloc(p->strings, size *= 2);
+				if(!newstrings) goto done;
+				p->strings = newstrings;
+			}
+			n = read(bin, p->strings + len, size - len - 1);
+			if(n > 0) len += n;
+		} while(n > 0 || (n == -1 && errno == EINTR));
+		// split the lines in place, the empty ones are skipped
+		p->strings[len++] = '\n';
+		for(; lines < len; lines++){
+			if(p->strings[lines] != '\n') p->strings[out++] = p->strings[lines];
+			else if(out > start){
+				p->strings[out++] = 0;
+				start = out;
+				nstrings++;
+			}
+		}
+	}
+	if(!(p->tmpl = malloc(nstrings * sizeof *p->tmpl))) goto done;
+	char *str = p->strings;
+	for(int k = 0; k < nstrings; k++, str += strlen(str) + 1) p->tmpl[k] = str;
+	p->args = p->tmpl + p->ntmpl;
+	p->nargs = nstrings - p->ntmpl;
+	ok = 1;
+	if(!p->nargs) goto done; // nothing to run
+	p->slottask = malloc(p->njobs * sizeof *p->slottask);
+	p->proctask = malloc(p->nargs * sizeof *p->proctask);
+	p->exits = malloc(p->nargs * sizeof *p->exits);
+	p->cpus = malloc(CPU_SETSIZE * sizeof *p->cpus);
+	if(!p->slottask || !p->proctask || !p->exits || !p->cpus) goto done;
+	for(int k = 0; k < p->njobs; k++) p->slottask[k] = -1;
+	for(int k = 0; k < p->nargs; k++) p->exits[k] = -1;
+	for(int c = 0, k = 0; c < CPU_SETSIZE; c++){
+		if(CPU_ISSET(c, &cpus)) p->cpus[k++] = c;
+	}
+	// the redirections of the builtin are closed once it returns, the tasks started later keep them
+	fflush(bout);
+	p->in = fcntl(bin, F_DUPFD_CLOEXEC, 0);
+	p->out = fcntl(fileno(bout), F_DUPFD_CLOEXEC, 0);
+	if((jid = lowestAvailJID()) == -1){
+		printf("No Job ID left to be used\n");
+		goto done;
+	}
+	setjobpid(jid, 0);
+	jobs[jid].par = p;
+	if(jobs[jid].timeout) armTimeout(jid, jobs[jid].timeout);
+	setJobCmd(jid);
+	jobs[jid].status = background ? 0 : 2;
+	if(!background) fglaunch = jid;
+	int running = resumeTasks(jid);
+	fglaunch = -1;
+	if(running && !background) waitfgjob(jid);
+	else if(!background) takeTerminal(jid);
+	return 1;
+done:
+	freeParallel(p);
+	return ok;
+}
+
+// argv[i] is the unquoted operator op (|, <, >, ...), arg is a pointer into argv
+int isop(char **arg, const char *op){
+	return !argquoted[arg - argv] && !strcmp(*arg, op);
+}
+
+/* Parse the redirection at arg into r and set nr to the number of redirections, return the
+ * number of words it takes, 0 if it isn't one */
+// [N]> file, [N]>> file, [N]< file, &> file, &>> file (stdout and stderr) and [N]>&M (fd N
+// becomes a copy of M, the operator and the fds are one word)
+int parseRedirect(char **arg, struct redirect *r, int *nr){
+	const char *op = *arg;
+	int fd = -1;
+	if(argquoted[arg - argv]) return 0;
+	if(isdigit((unsigned char)op[0])) fd = *op++ - '0';
+	// only the standard fds can be copied, the others are the shell's own
+	if(op[0] == '>' && op[1] == '&' && op[2] >= '0' && op[2] <= '2' && !op[3]){
+		*r = (struct redirect){ fd == -1 ? STDOUT_FILENO : fd, 0, NULL, op[2] - '0' };
+		*nr = 1;
+		return 1;
+	}
+	int both = fd == -1 && op[0] == '&' && op[1] == '>';
+	if(both) op++;
+	if(!strcmp(op, ">")) *r = (struct redirect){ STDOUT_FILENO, O_CREAT|O_WRONLY|O_TRUNC, arg[1], -1 };
+	// add write option, and remove truncate for appending to file to work properly
+	else if(!strcmp(op, ">>")) *r = (struct redirect){ STDOUT_FILENO, O_CREAT|O_WRONLY|O_APPEND, arg[1], -1 };
+	else if(!strcmp(op, "<") && !both) *r = (struct redirect){ STDIN_FILENO, O_RDONLY, arg[1], -1 };
+	else return 0;
+	// argv[i - 1] > argv[i + 1], argv[i - 1] is a program and argv[i + 1] is a file
+	if(!arg[1]) return 0;
+	if(fd != -1) r->fd = fd;
+	// &> file is > file 2>&1
+	if(both) r[1] = (struct redirect){ STDERR_FILENO, 0, NULL, STDOUT_FILENO };
+	*nr = 1 + both;
+	return 2;
+}
+
+// parse the redirections of a stage into redirs, in the order they are given. They are applied
+// later as spawn file actions (general commands) or to temporary fds (builtins)
+void redirectIO(struct stage *st){
+	char **argv = st->argv;
+	int argc = st->argc;
+	// the lowest i such that argv[i] is a redirection
+	int redirect_start = -1;
+	st->redirs = redirs + nredirs;
+	st->nredirs = 0;
+	for(int i = 0; i < argc; ){
+		int nr;
+		int n = parseRedirect(argv + i, st->redirs + st->nredirs, &nr);
+		if(!n){
+			i++;
+			continue;
+		}
+		if(redirect_start == -1) redirect_start = i;
+		st->nredirs += nr;
+		i += n;
+	}
+	nredirs += st->nredirs;
+	if(redirect_start != -1){
+		// only parse the cmd and its argument and the argument where the redirection symbol starts
+		// > test.txt echo "hello" works in bash but this is a simple shell
+		argv[redirect_start] = NULL;
+		st->argc = redirect_start;
+	}
+}
+
+/* Split argv at | and |: into stages, return 0 if a stage is empty */
+int splitPipeline(int argc){
+	int start = 0;
+	nstages = 0;
+	nredirs = 0;
+	for(int i = 0; i <= argc; i++){
+		int metered = i < argc && isop(argv + i, "|:");
+		if(i < argc && !isop(argv + i, "|") && !metered) continue;
+		if(i == start) return 0; // "| cmd", "cmd |" or "a | | b"
+		struct stage *st = stages + nstages++;
+		st->argv = argv + start;
+		st->argc = i - start;
+		st->metered = metered;
+		argv[i] = NULL;
+		redirectIO(st);
+		start = i + 1;
+	}
+	return 1;
+}
+
+int parseCmd(int argc);
+
+/* Return 1 if the argc words of argv are a pipeline */
+int isPipeline(int argc){
+	for(int i = 0; i < argc; i++) if(isop(argv + i, "|") || isop(argv + i, "|:")) return 1;
+	return 0;
+}
+
+// make argv and argquoted start n words further, n < 0 to shift them back
+void shiftArgs(int n){
+	argv += n;
+	argquoted += n;
+}
+
+/* Run the words of argv from skip on as a command line of their own, return like parseCmd */
+// for the builtins running the command given as their arguments
+int runArgsFrom(int argc, int skip){
+	// the & taken off by parseCmd belongs to the command
+	if(background){
+		argv[argc] = "&";
+		argquoted[argc++] = 0;
+	}
+	shiftArgs(skip);
+	int ret = parseCmd(argc - skip);
+	shiftArgs(-skip);
+	return ret;
+}
+
+int processBuiltInTime(int argc, int jid){
+	double start = now();
+	struct rusage self, selfend;
+	getrusage(RUSAGE_SELF, &self);
+	lastwall = -1;
+	// run the command as if argv started after time
+	int ret = runArgsFrom(argc, 1);
+	if(ret == 1){
+		if(lastwall < 0){ // a builtin, it ran in the shell
+			getrusage(RUSAGE_SELF, &selfend);
+			timersub(&selfend.ru_utime, &self.ru_utime, &selfend.ru_utime);
+			timersub(&selfend.ru_stime, &self.ru_stime, &selfend.ru_stime);
+			selfend.ru_nvcsw -= self.ru_nvcsw;
+			selfend.ru_nivcsw -= self.ru_nivcsw;
+			printUsage(now() - start, &selfend);
+		}
+		else printUsage(lastwall, &lastusage);
+	}
+	return ret;
+}
+
+// limit [-j N] [--load L] [--psi P]: admit a background job only while less than N jobs run,
+// the load average is below L and the cpu pressure below P%, 0 for no limit. Without
+// arguments, print the limits
+int processBuiltInLimit(int argc, int jid){
+	if(argc == 1){
+		fprintf(bout, "limit -j %i --load %g --psi %g\n", limitjobs, limitload, limitpsi);
+		return 1;
+	}
+	for(int i = 1; i < argc; i++){
+		if(i + 1 == argc || atof(argv[i + 1]) < 0) return 0;
+		if(!strcmp(argv[i], "-j")) limitjobs = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--load")) limitload = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--psi")) limitpsi = atof(argv[++i]);
+		else return 0;
+	}
+	if((limitload || limitpsi) && queuefd == -1){
+		struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_QUEUE, 0) } };
+		queuefd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(queuefd != -1 && epoll_ctl(epfd, EPOLL_CTL_ADD, queuefd, &ev) == -1){
+			close(queuefd);
+			queuefd = -1;
+		}
+	}
+	// a higher limit admits some now
+	admitJobs();
+	return 1;
+}
+
+// queue [-p prio] command...: run command in the background once admitted, before the queued
+// jobs of a lower prio (default 0)
+int processBuiltInQueue(int argc, int jid){
+	int i = 1, prio = 0;
+	if(!strcmp(argv[1], "-p")){
+		// -p prio without a command
+		if(argc < 4) return 0;
+		prio = atoi(argv[2]);
+		i = 3;
+	}
+	// only general commands can be queued, the utilities run as their program
+	struct builtin *b = findBuiltIn(argv[i]);
+	if(b && !(b->flags & BI_UTILITY)) return 0;
+	shiftArgs(i);
+	int ok = splitPipeline(argc - i);
+	shiftArgs(-i);
+	if(!ok) return 0;
+	if((jid = lowestAvailJID()) == -1){
+		printf("No Job ID left to be used\n");
+		return 1;
+	}
+	capturenext = captureon;
+	if(!nextpin) nextpin = autoPin();
+	if(!queueJob(jid, prio)){
+		laststatus = 1;
+		return 1;
+	}
+	admitJobs();
+	return 1;
+}
+
+/* Arm the timerfd ending the wait of a builtin secs from now (0: disarm), return 0 if failed */
+int armSleep(double secs){
+	if(sleepfd == -1){
+		struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_SLEEP, 0) } };
+		sleepfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(sleepfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, sleepfd, &ev) == -1){
+			if(sleepfd != -1) close(sleepfd);
+			sleepfd = -1;
+			return 0;
+		}
+	}
+	struct itimerspec t = { { 0, 0 }, { (time_t)secs, (secs - (time_t)secs) * 1e9 } };
+	if(secs > 0 && !t.it_value.tv_sec && !t.it_value.tv_nsec) t.it_value.tv_nsec = 1;
+	return timerfd_settime(sleepfd, 0, &t, NULL) != -1;
+}
+
+/* Return the seconds of a duration such as 10, 1.5s, 500ms, 2m or 1h, -1 if invalid */
+double parseDuration(const char *s){
+	char *unit;
+	double d = strtod(s, &unit);
+	if(unit == s || d < 0) return -1;
+	if(!*unit || !strcmp(unit, "s")) return d;
+	if(!strcmp(unit, "ms")) return d / 1000;
+	if(!strcmp(unit, "m")) return d * 60;
+	if(!strcmp(unit, "h")) return d * 3600;
+	return -1;
+}
+
+// timeout [-k grace] duration command...: run command as a job that gets SIGTERM once
+// duration passed, then SIGKILL grace later (default 5 s). Its status is 124 then
+int processBuiltInTimeout(int argc, int jid){
+	int i = 1;
+	double grace = 5;
+	if(argc > 3 && !strcmp(argv[1], "-k")){
+		if((grace = parseDuration(argv[2])) < 0) return 0;
+		i = 3;
+	}
+	double timeout = parseDuration(argv[i]);
+	if(timeout <= 0 || ++i >= argc) return 0;
+	// the next job created takes it
+	nexttimeout = timeout;
+	nextgrace = grace;
+	int ret = runArgsFrom(argc, i);
+	// a builtin that created no job
+	nexttimeout = 0;
+	return ret;
+}
+
+// deadline %jid duration [grace]: job jid gets SIGTERM once duration passed from now, then
+// SIGKILL grace later. A duration of 0 removes it
+int processBuiltInDeadline(int argc, int jid){
+	double timeout = parseDuration(argv[2]);
+	double grace = argc == 4 ? parseDuration(argv[3]) : 5;
+	if(timeout < 0 || grace < 0) return 0;
+	jobs[jid].timeout = timeout;
+	jobs[jid].grace = grace;
+	jobs[jid].timedout = 0;
+	// a queued job is armed once it is launched
+	if(jobs[jid].status != 3 && !armTimeout(jid, timeout)){
+		fprintf(berr, "deadline: %s\n", strerror(errno));
+		laststatus = 1;
+	}
+	return 1;
+}
+
+// pin [auto [-w N] | off]: each & job started from now on gets the next N cpus (1) of the shell's
+// in turn
+// pin %jid cpulist: move the processes of job jid, and their memory on a NUMA host, to cpus
+// pin cpulist command...: run command on cpus
+int processBuiltInPin(int argc, int jid){
+	cpu_set_t cpus;
+	if(argc == 1){
+		if(pinwidth) fprintf(bout, "pin auto -w %i\n", pinwidth);
+		else fprintf(bout, "pin off\n");
+		return 1;
+	}
+	if(!strcmp(argv[1], "auto") || !strcmp(argv[1], "off")){
+		int width = 1;
+		if(argc == 4 && !strcmp(argv[2], "-w")) width = atoi(argv[3]);
+		else if(argc != 2) return 0;
+		if(background || width < 1) return 0;
+		pinwidth = argv[1][0] == 'a' ? width : 0;
+		pinnext = 0;
+		return 1;
+	}
+	if(argv[1][0] == '%'){
+		if(argc != 3 || background) return 0;
+		if((jid = getcmdjid()) == -1 || jobs[jid].status == 2 || !parseCpus(argv[2], &cpus)) return 0;
+		// a queued job is placed once it is launched
+		if(jobs[jid].pid > 0 && pinGroup(jobs[jid].pid, &cpus)){
+			fprintf(berr, "pin: %s: %s: some of its processes couldn't be moved\n", argv[1], argv[2]);
+			laststatus = 1;
+			return 1;
+		}
+		cpu_set_t *set = jobs[jid].cpus ? jobs[jid].cpus : malloc(sizeof *set);
+		if(!set) return 0;
+		*set = cpus;
+		jobs[jid].cpus = set;
+		return 1;
+	}
+	if(argc < 3 || !parseCpus(argv[1], &cpus) || !(nextpin = malloc(sizeof *nextpin))) return 0;
+	*nextpin = cpus;
+	int ret = runArgsFrom(argc, 2);
+	// a builtin that created no job
+	free(nextpin);
+	nextpin = NULL;
+	return ret;
+}
+
+/* Parse limit -m size[k|m|g] or -c cpus (1.5: one and a half) into the value of memory.max or
+ * cpu.max, return 0 if invalid */
+int parseLimit(const char *opt, const char *arg, char *value, size_t size){
+	char *unit;
+	if(!strcmp(arg, "max")){
+		snprintf(value, size, opt[1] == 'm' ? "max" : "max 100000");
+		return 1;
+	}
+	if(opt[1] == 'c'){
+		double cpus = strtod(arg, &unit);
+		// the quota of cpu time per 100ms period, at least 1ms
+		if(*unit || cpus < 0.01) return 0;
+		snprintf(value, size, "%lld 100000", (long long)(cpus * 100000));
+		return 1;
+	}
+	unsigned long long bytes = strtoull(arg, &unit, 10);
+	if(*unit == 'k' || *unit == 'K') bytes <<= 10, unit++;
+	else if(*unit == 'm' || *unit == 'M') bytes <<= 20, unit++;
+	else if(*unit == 'g' || *unit == 'G') bytes <<= 30, unit++;
+	if(*unit || !bytes) return 0;
+	snprintf(value, size, "%llu", bytes);
+	return 1;
+}
+
+// cgroup [on | off] [-m size[k|m|g] | -m max] [-c cpus | -c max]: each job started from now on
+// runs in a cgroup v2 of its own, with at most size of memory and cpus of cpu time
+// cgroup %jid [-m ...] [-c ...]: change the limits of job jid
+int processBuiltInCgroup(int argc, int jid){
+	char memmax[32] = "", cpumax[32] = "";
+	int i = 1, on = -1;
+	if(argc == 1){
+		fprintf(bout, "cgroup %s", cgroupon ? "on" : "off");
+		if(*cgmemmax) fprintf(bout, " -m %s", cgmemmax);
+		if(*cgcpumax) fprintf(bout, " -c %.2f", atof(cgcpumax) / 100000);
+		fprintf(bout, "\n");
+		return 1;
+	}
+	if(argv[1][0] == '%'){
+		if((jid = getcmdjid()) == -1 || jobs[jid].cgroup == -1){
+			fprintf(berr, "cgroup: %s: not in a cgroup\n", argv[1]);
+			laststatus = 1;
+			return 1;
+		}
+		i = 2;
+	}
+	else if(!strcmp(argv[1], "on") || !strcmp(argv[1], "off")){
+		on = argv[1][1] == 'n';
+		i = 2;
+	}
+	for(; i < argc; i++){
+		if(i + 1 >= argc || (strcmp(argv[i], "-m") && strcmp(argv[i], "-c"))) return 0;
+		if(!parseLimit(argv[i], argv[i + 1], argv[i][1] == 'm' ? memmax : cpumax, sizeof memmax)) return 0;
+		i++;
+	}
+	if(on == 1 && cgroupfd == -1 && !initCgroups()){
+		fprintf(berr, "cgroup: no cgroup v2 hierarchy to write to, the jobs are signaled\n");
+		laststatus = 1;
+		return 1;
+	}
+	if(on != -1) cgroupon = on;
+	if(cgroupfd != -1){
+		// the cgroups are there without the controllers, freeze and kill work then
+		if(*memmax && !cgController("memory")) fprintf(berr, "cgroup: the memory controller isn't delegated, -m has no effect\n");
+		if(*cpumax && !cgController("cpu")) fprintf(berr, "cgroup: the cpu controller isn't delegated, -c has no effect\n");
+	}
+	if(jid != -1){
+		if((*memmax && !cgWrite(jobs[jid].cgroup, "memory.max", memmax)) || (*cpumax && !cgWrite(jobs[jid].cgroup, "cpu.max", cpumax))){
+			fprintf(berr, "cgroup: %s: %s\n", argv[1], strerror(errno));
+			laststatus = 1;
+		}
+		return 1;
+	}
+	if(*memmax) strcpy(cgmemmax, strcmp(memmax, "max") ? memmax : "");
+	if(*cpumax) strcpy(cgcpumax, strncmp(cpumax, "max", 3) ? cpumax : "");
+	return 1;
+}
+
+// zygote [N | off]: keep N zygotes ready to launch the commands, off launches them with posix_spawn
+int processBuiltInZygote(int argc, int jid){
+	if(argc == 1){
+		fprintf(bout, "zygote %i, %i idle, %lu launches\n", zygotepool, nzygotes, zygotelaunches);
+		return 1;
+	}
+	char *end;
+	long n = strcmp(argv[1], "off") ? strtol(argv[1], &end, 10) : 0;
+	if(n < 0 || n > 1024 || (strcmp(argv[1], "off") && (end == argv[1] || *end))) return 0;
+	if(n > zygotepool){
+		struct zygote *newzygotes = realloc(zygotes, n * sizeof *zygotes);
+		if(!newzygotes){
+			fprintf(berr, "zygote: %s\n", strerror(errno));
+			laststatus = 1;
+			return 1;
+		}
+		zygotes = newzygotes;
+	}
+	// a zygote exits once its socket is closed
+	while(nzygotes > n) close(zygotes[--nzygotes].sock);
+	zygotepool = n;
+	refillZygotes();
+	return 1;
+}
+
+// echo [-n] word...
+int processBuiltInEcho(int argc, int jid){
+	int i = 1;
+	if(argc > 1 && !strcmp(argv[1], "-n")) i++;
+	for(int first = i; i < argc; i++) fprintf(bout, "%s%s", i > first ? " " : "", argv[i]);
+	if(argc == 1 || strcmp(argv[1], "-n")) fputc('\n', bout);
+	return 1;
+}
+
+int processBuiltInTrue(int argc, int jid){
+	return 1;
+}
+
+int processBuiltInFalse(int argc, int jid){
+	laststatus = 1;
+	return 1;
+}
+
+// pwd [-L | -P]: the shell doesn't keep a logical cwd, both print the physical one
+int processBuiltInPwd(int argc, int jid){
+	char cwd[MAX_PATH];
+	if(argc == 2 && strcmp(argv[1], "-L") && strcmp(argv[1], "-P")) return 0;
+	if(!getcwd(cwd, sizeof cwd)){
+		fprintf(berr, "pwd: %s\n", strerror(errno));
+		laststatus = 1;
+	}
+	else fprintf(bout, "%s\n", cwd);
+	return 1;
+}
+
+// sleep duration...: the durations add up like coreutils' sleep. The shell waits in its event
+// loop meanwhile, so the background jobs are still reaped and ^C ends the sleep
+int processBuiltInSleep(int argc, int jid){
+	double total = 0;
+	for(int i = 1; i < argc; i++){
+		double d = parseDuration(argv[i]);
+		if(d < 0){
+			fprintf(berr, "sleep: invalid time interval '%s'\n", argv[i]);
+			laststatus = 1;
+			return 1;
+		}
+		total += d;
+	}
+	if(total <= 0) return 1;
+	if(!armSleep(total)){
+		fprintf(berr, "sleep: %s\n", strerror(errno));
+		laststatus = 1;
+		return 1;
+	}
+	inwait = 1;
+	while(inwait == 1) waitEvents(0);
+	if(inwait == 2){
+		laststatus = 128 + SIGINT;
+		armSleep(0);
+	}
+	inwait = 0;
+	return 1;
+}
+
+// wait [-n] [--timeout duration] [%jid | pid]...: wait for the jobs (the running and queued ones
+// if none) to end, or for the first of them with -n. Its status is the one of the last job
+// listed (0 if none), of the first one with -n, 124 if the timeout passed first. A stopped job
+// doesn't end, its status is 128 + SIGTSTP
+// the jobs are still reaped by reapChildren only, wait is woken by the event loop like fg
+int processBuiltInWait(int argc, int jid){
+	double timeout = 0;
+	int i, status = 0;
+	waitany = 0;
+	for(i = 1; i < argc && argv[i][0] == '-' && !argquoted[i]; i++){
+		if(!strcmp(argv[i], "-n")) waitany = 1;
+		else if(!strcmp(argv[i], "--timeout") && i + 1 < argc && (timeout = parseDuration(argv[++i])) > 0);
+		else return 0;
+	}
+	nwaiting = 0;
+	waitlast = -1;
+	if(i == argc){
+		ndonejobs = 0;
+		for(int j = 0; j < njobslots; j++){
+			if(jobs[j].pid == -1 || (jobs[j].status != 0 && jobs[j].status != 3)) continue;
+			jobs[j].waited = 1;
+			nwaiting++;
+		}
+		// nothing to wait for
+		if(waitany && !nwaiting) status = 127;
+	}
+	for(; i < argc; i++){
+		int j = getjid(argv[i]), done = -1;
+		waitlast = j;
+		// it ended already
+		if(j == -1 && (done = argv[i][0] == '%' ? forgetDoneJob(atoi(argv[i] + 1) - 1, -1) : forgetDoneJob(-1, atoi(argv[i]))) != -1) status = done;
+		else if(j == -1){
+			fprintf(berr, "wait: %s: no such job\n", argv[i]);
+			status = 127;
+		}
+		else if(jobs[j].status == 1) status = 128 + SIGTSTP;
+		else if(!jobs[j].waited){
+			jobs[j].waited = 1;
+			nwaiting++;
+		}
+	}
+	waitstatus = status;
+	if(nwaiting){
+		if(timeout && !armSleep(timeout)){
+			fprintf(berr, "wait: %s\n", strerror(errno));
+			timeout = 0;
+		}
+		inwait = 1;
+		while(inwait == 1) waitEvents(0);
+		status = inwait == 2 ? 128 + SIGINT : nwaiting && waitany != 2 ? 124 : waitstatus;
+		if(timeout) armSleep(0);
+		inwait = 0;
+		// the ones left when the timeout passed or ^C
+		for(int j = 0; j < njobslots; j++) jobs[j].waited = 0;
+		nwaiting = 0;
+	}
+	laststatus = status;
+	return 1;
+}
+
+/* Return the unary test op of arg: 1 true, 0 false, -1 if op isn't one */
+int testUnary(const char *op, const char *arg){
+	struct stat st;
+	if(op[0] != '-' || !op[1] || op[2]) return -1;
+	switch(op[1]){
+		case 'z': return !*arg;
+		case 'n': return *arg != 0;
+		case 'e': return !stat(arg, &st);
+		case 'f': return !stat(arg, &st) && S_ISREG(st.st_mode);
+		case 'd': return !stat(arg, &st) && S_ISDIR(st.st_mode);
+		case 'p': return !stat(arg, &st) && S_ISFIFO(st.st_mode);
+		case 's': return !stat(arg, &st) && st.st_size > 0;
+		case 'h': // -- DROP DOWN --
+		case 'L': return !lstat(arg, &st) && S_ISLNK(st.st_mode);
+		case 'r': return !access(arg, R_OK);
+		case 'w': return !access(arg, W_OK);
+		case 'x': return !access(arg, X_OK);
+		case 't': return isatty(atoi(arg));
+	}
+	return -1;
+}
+
+/* Return the binary test a op b: 1 true, 0 false, -1 if op isn't one, -2 if a or b isn't
+ * an integer */
+int testBinary(const char *a, const char *op, const char *b){
+	const char *intops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+	if(!strcmp(op, "=") || !strcmp(op, "==")) return !strcmp(a, b);
+	if(!strcmp(op, "!=")) return strcmp(a, b) != 0;
+	int i = 0;
+	while(i < 6 && strcmp(op, intops[i])) i++;
+	if(i == 6) return -1;
+	char *end;
+	long x = strtol(a, &end, 10);
+	if(!*a || *end) return -2;
+	long y = strtol(b, &end, 10);
+	if(!*b || *end) return -2;
+	int results[] = { x == y, x != y, x < y, x <= y, x > y, x >= y };
+	return results[i];
+}
+
+/* Return the exit status of test with the n words of args: 0 true, 1 false, 2 if invalid */
+// POSIX's rules by number of arguments, without the obsolescent -a and -o
+int evalTest(char **args, int n){
+	int r;
+	switch(n){
+		case 0: return 1;
+		case 1: return !*args[0];
+		case 2:
+			if(!strcmp(args[0], "!")) return evalTest(args + 1, 1) ^ 1;
+			if((r = testUnary(args[0], args[1])) >= 0) return !r;
+			fprintf(berr, "test: %s: unary operator expected\n", args[0]);
+			return 2;
+		case 3:
+			if((r = testBinary(args[0], args[1], args[2])) >= 0) return !r;
+			if(r == -2){
+				fprintf(berr, "test: integer expression expected\n");
+				return 2;
+			}
+			if(!strcmp(args[0], "!")) return (r = evalTest(args + 1, 2)) == 2 ? 2 : !r;
+			if(!strcmp(args[0], "(") && !strcmp(args[2], ")")) return evalTest(args + 1, 1);
+			fprintf(berr, "test: %s: binary operator expected\n", args[1]);
+			return 2;
+		case 4:
+			if(!strcmp(args[0], "!")) return (r = evalTest(args + 1, 3)) == 2 ? 2 : !r;
+			if(!strcmp(args[0], "(") && !strcmp(args[3], ")")) return evalTest(args + 1, 2);
+	}
+	fprintf(berr, "test: too many arguments\n");
+	return 2;
+}
+
+// test expression or [ expression ]
+int processBuiltInTest(int argc, int jid){
+	if(!strcmp(argv[0], "[") && strcmp(argv[--argc], "]")){
+		fprintf(berr, "[: missing ']'\n");
+		laststatus = 2;
+		return 1;
+	}
+	laststatus = evalTest(argv + 1, argc - 1);
+	return 1;
+}
+
+// the counters and histograms in Prometheus' text format
+void printStats(FILE *f){
+	struct{ const char *name, *help; unsigned long value; } counters[] = {
+		{ "commands", "Command lines parsed", stats.commands },
+		{ "spawns", "Processes started by posix_spawn", stats.spawns },
+		{ "zygote_launches", "Processes started by a zygote", zygotelaunches },
+		{ "forks", "Fork fallbacks for files posix_spawn can't exec", stats.forks },
+		{ "launch_failures", "Stages that couldn't be started", stats.launchfailures },
+		{ "jobs", "Jobs started", njobsrun },
+		{ "reaped", "Job processes that terminated", stats.reaped },
+		{ "orphans", "Children reaped that were no job's anymore", stats.orphans },
+		{ "fg_sigint", "^C that interrupted the foreground job", stats.sigint },
+		{ "fg_sigtstp", "^Z that stopped the foreground job", stats.sigtstp },
+	};
+	for(size_t i = 0; i < sizeof counters / sizeof *counters; i++){
+		fprintf(f, "# HELP hw2_%s_total %s\n# TYPE hw2_%s_total counter\nhw2_%s_total %lu\n", counters[i].name,
+			counters[i].help, counters[i].name, counters[i].name, counters[i].value);
+	}
+	// fixed bounds, a series keeps the same buckets from one scrape to the next
+	const double le[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300 };
+	struct{ const char *name, *help; struct histogram *h; } hists[] = {
+		{ "spawn_seconds", "Time to start a process", &spawnhist },
+		{ "job_lifetime_seconds", "Time from launch to termination of a job", &lifetimehist },
+	};
+	for(size_t i = 0; i < sizeof hists / sizeof *hists; i++){
+		struct histogram *h = hists[i].h;
+		fprintf(f, "# HELP hw2_%s %s\n# TYPE hw2_%s histogram\n", hists[i].name, hists[i].help, hists[i].name);
+		unsigned long below = 0;
+		unsigned b = 0;
+		for(size_t k = 0; k < sizeof le / sizeof *le; k++){
+			while(b < HIST_BUCKETS && histValue(b) <= le[k] * 1e6) below += h->counts[b++];
+			fprintf(f, "hw2_%s_bucket{le=\"%g\"} %lu\n", hists[i].name, le[k], below);
+		}
+		fprintf(f, "hw2_%s_bucket{le=\"+Inf\"} %lu\nhw2_%s_sum %.6f\nhw2_%s_count %lu\n", hists[i].name, h->n,
+			hists[i].name, h->sum, hists[i].name, h->n);
+	}
+}
+
+// write the textfile, through a temporary file renamed over it so that a scrape never reads a
+// partial one
+void writeStats(){
+	char *tmp = malloc(strlen(statspath) + 5);
+	if(!tmp) return;
+	sprintf(tmp, "%s.tmp", statspath);
+	FILE *f = fopen(tmp, "w");
+	if(f){
+		printStats(f);
+		if(fclose(f) || rename(tmp, statspath)) unlink(tmp);
+	}
+	free(tmp);
+}
+
+// stats [-r] [--textfile path [-i seconds] | --textfile off]: print the counters and the
+// spawn latency and job lifetime histograms, -r resets them (the session's jobs and zygote
+// launches are kept). --textfile writes them to path every 15 s (or -i) in Prometheus' text
+// format, for node_exporter's textfile collector
+int processBuiltInStats(int argc, int jid){
+	int reset = 0;
+	double interval = 15;
+	const char *path = NULL;
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "-r")) reset = 1;
+		else if(!strcmp(argv[i], "--textfile") && i + 1 < argc) path = argv[++i];
+		else if(!strcmp(argv[i], "-i") && i + 1 < argc && (interval = parseDuration(argv[++i])) > 0) continue;
+		else return 0;
+	}
+	if(path){
+		free(statspath);
+		statspath = NULL;
+		if(strcmp(path, "off")){
+			if(statsfd == -1){
+				struct epoll_event ev = { EPOLLIN, { .u64 = EVENT(EV_STATS, 0) } };
+				statsfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+				if(statsfd != -1 && epoll_ctl(epfd, EPOLL_CTL_ADD, statsfd, &ev) == -1){
+					close(statsfd);
+					statsfd = -1;
+				}
+			}
+			if(statsfd == -1){
+				fprintf(berr, "stats: %s\n", strerror(errno));
+				laststatus = 1;
+				return 1;
+			}
+			statspath = strdup(path);
+		}
+		struct timespec t = { (time_t)interval, (interval - (time_t)interval) * 1e9 };
+		struct itimerspec it = { t, t };
+		if(!statspath) it = (struct itimerspec){ { 0, 0 }, { 0, 0 } };
+		if(statsfd != -1) timerfd_settime(statsfd, 0, &it, NULL);
+		if(statspath) writeStats();
+		return 1;
+	}
+	if(reset){
+		memset(&stats, 0, sizeof stats);
+		memset(&spawnhist, 0, sizeof spawnhist);
+		memset(&lifetimehist, 0, sizeof lifetimehist);
+		return 1;
+	}
+	fprintf(bout, "commands %lu, jobs %i, reaped %lu, orphans %lu\n", stats.commands, njobsrun, stats.reaped, stats.orphans);
+	fprintf(bout, "launches: %lu posix_spawn, %lu zygote, %lu fork fallbacks, %lu failed\n", stats.spawns,
+		zygotelaunches, stats.forks, stats.launchfailures);
+	fprintf(bout, "foreground job: %lu ^C, %lu ^Z\n", stats.sigint, stats.sigtstp);
+	struct{ const char *name; struct histogram *h; } hists[] = { { "spawn", &spawnhist }, { "lifetime", &lifetimehist } };
+	for(int i = 0; i < 2; i++){
+		struct histogram *h = hists[i].h;
+		if(!h->n){
+			fprintf(bout, "%-8s n 0\n", hists[i].name);
+			continue;
+		}
+		fprintf(bout, "%-8s n %lu  mean %.0f  p50 %lu  p90 %lu  p99 %lu  max %lu us\n", hists[i].name, h->n, h->sum / h->n * 1e6,
+			histQuantile(h, 0.5), histQuantile(h, 0.9), histQuantile(h, 0.99), histQuantile(h, 1));
+	}
+	return 1;
+}
+
+// capture [on | off] [-s size[k|m]]: the stdout and stderr of the background jobs started from
+// now on go to a ring of size bytes each (default 1m) instead of the terminal
+int processBuiltInCapture(int argc, int jid){
+	if(argc == 1){
+		fprintf(bout, "capture %s -s %zu\n", captureon ? "on" : "off", capturesize);
+		return 1;
+	}
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "on")) captureon = 1;
+		else if(!strcmp(argv[i], "off")) captureon = 0;
+		else if(!strcmp(argv[i], "-s") && i + 1 < argc){
+			char *unit;
+			unsigned long long size = strtoull(argv[++i], &unit, 10);
+			if(*unit == 'k' || *unit == 'K') size <<= 10, unit++;
+			else if(*unit == 'm' || *unit == 'M') size <<= 20, unit++;
+			if(*unit || !size || size > (1ULL << 30)) return 0;
+			capturesize = size;
+		}
+		else return 0;
+	}
+	return 1;
+}
+
+// output %jid [-t [lines] | -f]: print the captured output of job jid, its last lines (10),
+// or all of it and then what it writes until it terminates or ^C. Once job jid terminated, the
+// output of the last captured job that had jid is printed
+int processBuiltInOutput(int argc, int jid){
+	int follow = 0, lines = -1;
+	if(argv[1][0] != '%') return 0;
+	if(argc == 3 && !strcmp(argv[2], "-f")) follow = 1;
+	else if(argc > 2 && !strcmp(argv[2], "-t")){
+		lines = argc == 4 ? atoi(argv[3]) : 10;
+		if(lines < 0) return 0;
+	}
+	else if(argc > 2) return 0;
+	jid = atoi(argv[1] + 1) - 1;
+	struct capture *c = 0 <= jid && jid < njobslots ? jobs[jid].cap ? jobs[jid].cap : jobs[jid].donecap : NULL;
+	if(!c){
+		fprintf(berr, "output: %s: no captured output\n", argv[1]);
+		laststatus = 1;
+		return 1;
+	}
+	fflush(bout);
+	printCapture(c, lines >= 0 ? tailCapture(c, lines) : 0, fileno(bout));
+	if(follow && c->rd != -1){
+		c->follow = fileno(bout);
+		inwait = 1;
+		while(inwait == 1 && c->rd != -1) waitEvents(0);
+		if(inwait == 2) laststatus = 128 + SIGINT;
+		inwait = 0;
+		c->follow = -1;
+	}
+	return 1;
+}
+
+// builtin name args: run the builtin name even where its program would run instead. command
+// name args: run the program name, not the builtin
+int runLookup(int argc, int how){
+	forcelookup = how;
+	int ret = runArgsFrom(argc, 1);
+	forcelookup = 0;
+	return ret;
+}
+
+int processBuiltInBuiltin(int argc, int jid){
+	return runLookup(argc, 1);
+}
+
+int processBuiltInCommand(int argc, int jid){
+	return runLookup(argc, -1);
+}
+
+struct builtin builtins[] = {
+	{ "jobs", processBuiltInJobs, 1, 2, 0, 0 }, // jobs or jobs -l
+	{ "quit", processBuiltInQuit, 1, 1, 0, 0 },
+	{ "cd", processBuiltInCd, 2, 2, 0, 0 },
+	{ "hash", processBuiltInHash, 1, 2, 0, 0 }, // hash or hash -r
+	{ "fg", processBuiltInFg, 2, 2, 1 << 0 | 1 << 1 | 1 << 3, 0 }, // running, stopped or queued
+	{ "bg", processBuiltInBg, 2, 2, 1 << 1, 0 }, // stopped
+	{ "kill", processBuiltInKill, 2, 2, 1 << 0 | 1 << 1 | 1 << 3, 0 },
+	// parallel [-j N] [--pin] command... ::: argument... or < file
+	{ "parallel", processBuiltInParallel, 2, -1, 0, BI_BACKGROUND },
+	{ "time", processBuiltInTime, 2, -1, 0, BI_PREFIX }, // time command...
+	{ "trace", processBuiltInTrace, 1, -1, 0, 0 },
+	{ "notify", processBuiltInNotify, 1, 4, 0, 0 },
+	{ "limit", processBuiltInLimit, 1, 7, 0, 0 },
+	{ "queue", processBuiltInQueue, 2, -1, 0, BI_PREFIX | BI_BACKGROUND },
+	{ "timeout", processBuiltInTimeout, 3, -1, 0, BI_PREFIX | BI_BACKGROUND },
+	{ "deadline", processBuiltInDeadline, 3, 4, 1 << 0 | 1 << 1 | 1 << 3, 0 },
+	{ "zygote", processBuiltInZygote, 1, 2, 0, 0 },
+	{ "echo", processBuiltInEcho, 1, -1, 0, BI_UTILITY },
+	{ "true", processBuiltInTrue, 1, -1, 0, BI_UTILITY },
+	{ "false", processBuiltInFalse, 1, -1, 0, BI_UTILITY },
+	{ "test", processBuiltInTest, 1, -1, 0, BI_UTILITY },
+	{ "[", processBuiltInTest, 2, -1, 0, BI_UTILITY },
+	{ "sleep", processBuiltInSleep, 2, -1, 0, BI_UTILITY | BI_WAITS },
+	{ "pwd", processBuiltInPwd, 1, 2, 0, BI_UTILITY },
+	{ "capture", processBuiltInCapture, 1, 4, 0, 0 },
+	{ "stats", processBuiltInStats, 1, 6, 0, 0 },
+	{ "output", processBuiltInOutput, 2, 4, 0, 0 },
+	{ "builtin", processBuiltInBuiltin, 2, -1, 0, BI_PREFIX | BI_BACKGROUND },
+	{ "command", processBuiltInCommand, 2, -1, 0, BI_PREFIX | BI_BACKGROUND },
+	{ "pin", processBuiltInPin, 1, -1, 0, BI_PREFIX | BI_BACKGROUND },
+	{ "cgroup", processBuiltInCgroup, 1, 6, 0, 0 },
+	{ "wait", processBuiltInWait, 1, -1, 0, 0 },
+};
+#define NBUILTINS (int)(sizeof builtins / sizeof *builtins)
+// builtinslot[hashseed(name, builtinseed) & (nbuiltinslots - 1)] is the index of the builtin
+// named name, -1 if none. The seed is searched once so that no two builtins collide, a lookup
+// is then one hash and one strcmp however many builtins there are
+short *builtinslot = NULL; // a short holds the index of up to 32767 builtins
+int nbuiltinslots = BUILTIN_SLOTS;
+unsigned builtinseed = 0;
+
+void initBuiltIns(){
+	int collision;
+	builtinslot = malloc(nbuiltinslots * sizeof *builtinslot);
+	do{
+		// the table is too crowded for a seed to be found quickly
+		if(++builtinseed % 1000 == 0) builtinslot = realloc(builtinslot, (nbuiltinslots *= 2) * sizeof *builtinslot);
+		collision = 0;
+		memset(builtinslot, -1, nbuiltinslots * sizeof *builtinslot);
+		for(int i = 0; i < NBUILTINS && !collision; i++){
+			short *slot = builtinslot + (hashseed(builtins[i].name, builtinseed) & (nbuiltinslots - 1));
+			collision = *slot != -1;
+			*slot = i;
+		}
+	} while(collision);
+}
+
+/* Return the builtin called name, NULL for a general command */
+struct builtin *findBuiltIn(const char *name){
+	int i = builtinslot[hashseed(name, builtinseed) & (nbuiltinslots - 1)];
+	return i != -1 && !strcmp(builtins[i].name, name) ? builtins + i : NULL;
+}
+
+int parseCmd(int argc){
+	if(*argv){
+		int forced = forcelookup;
+		forcelookup = 0;
+		struct builtin *b = forced < 0 ? NULL : findBuiltIn(*argv);
+		if(forced > 0 && !b){
+			fprintf(stderr, "builtin: %s: not a shell builtin\n", *argv);
+			laststatus = 1;
+			return 1;
+		}
+		background = !argquoted[argc-1] && argv[argc-1][0] == '&'; // possible background
+		// don't include the argv[i] = '&' since it can be an invalid argument (such
+		// as sleep 500 &)
+		if(background) argv[--argc] = NULL;
+		// a deadline needs a job
+		if(b && b->flags & BI_UTILITY && !forced && (background || nexttimeout || nextpin || isPipeline(argc) || (b->flags & BI_WAITS && ttyfd != -1))) b = NULL;
+		if(!b){ // general commands
+			if(!argc || !splitPipeline(argc)) return 0;
+			return background ? processGeneralBg() : processGeneralFg();
+		}
+		if(background && !(b->flags & BI_BACKGROUND)) return 0;
+		if(b->flags & BI_PREFIX) return argc < b->minargc ? 0 : b->run(argc, -1);
+		// builtins run in the shell and can't be piped
+		if(!splitPipeline(argc) || nstages > 1) return 0;
+		// the words before the redirections
+		argc = stages->argc;
+		if(argc < b->minargc || (b->maxargc != -1 && argc > b->maxargc)) return 0;
+		int jid = -1;
+		if(b->jobstatus){
+			jid = getcmdjid();
+			if(jid == -1 || !(b->jobstatus & 1 << jobs[jid].status)) return 0;
+		}
+		int in;
+		FILE *out, *err;
+		if(!openBuiltInRedirects(stages, &in, &out, &err)){
+			closeBuiltInRedirects(in, out, err);
+			laststatus = 1;
+			return 1;
+		}
+		// quit keeps the status of the previous command as the shell's exit status
+		if(b->run != processBuiltInQuit) laststatus = 0;
+		int ret = b->run(argc, jid);
+		closeBuiltInRedirects(in, out, err);
+		return ret;
+	}
+	return 1;
+}
+
+// ps -a | grep hw2 | cut -d ' ' -f 2
+
+/* Point cmdline at the next line of input, return its length or -1 at the end of input */
+// stdin is read in bulk with read() instead of stdio, whose buffer would hide lines from epoll.
+// Lines already read ahead (typed ahead, pasted or piped) are served without a syscall
+long readLine(){
+	size_t scanned = 0; // bytes of the pending line already searched for '\n'
+	while(1){
+		char *line = inbuf + inpos;
+		char *nl = memchr(line + scanned, '\n', inlen - inpos - scanned);
+		if(nl || (ineof && inpos < inlen)){
+			size_t len = (nl ? nl : inbuf + inlen) - line;
+			// the buffer isn't written, it can be a read-only mapping of a script
+			inpos += len + (nl != NULL);
+			cmdline = line;
+			cmdlinelen = len;
+			return len;
+		}
+		if(ineof) return -1;
+		scanned = inlen - inpos;
+		// move the incomplete line to the front, grow if it doesn't leave room for a full read
+		memmove(inbuf, inbuf + inpos, inlen - inpos);
+		inlen -= inpos;
+		inpos = 0;
+		if(insize - inlen < INPUT_BUFFER){
+			char *newbuf = realloc(inbuf, inlen + INPUT_BUFFER);
+			if(!newbuf) return -1;
+			inbuf = newbuf;
+			insize = inlen + INPUT_BUFFER;
+		}
+		if(waitEvents(1)){
+			ssize_t n = read(STDIN_FILENO, inbuf + inlen, insize - inlen);
+			if(n > 0) inlen += n;
+			else if(!n || (errno != EINTR && errno != EAGAIN)) ineof = 1;
+		}
+	}
+}
+
+/* Allocate cmdbuffer, argv, redirs and stages for a command of len characters from the arena,
+ * return 0 if out of memory */
+int allocCmd(size_t len){
+	// at most one word per 2 characters and a NULL
+	size_t words = len / 2 + 2;
+	cmdbuffer = arenaAlloc(len + 1);
+	argv = arenaAlloc(words * sizeof *argv);
+	argquoted = arenaAlloc(words);
+	redirs = arenaAlloc(words * sizeof *redirs);
+	stages = arenaAlloc(words * sizeof *stages);
+	return cmdbuffer && argv && argquoted && redirs && stages;
+}
+
+/* Split cmdline into argv, return argc or -1 if a quote is not closed */
+// single pass: the words are unquoted while being copied into cmdbuffer and argv points at
+// them. '...' is literal, "..." keeps the \\ \" \$ \` escapes and \ escapes any character
+// outside of quotes. An unquoted # starts a comment
+int tokenize(size_t len){
+	if(!allocCmd(len)) return -1;
+	const char *c = cmdline, *end = cmdline + len;
+	char *out = cmdbuffer;
+	int argc = 0;
+	while(1){
+		while(c < end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+		if(c == end || *c == '#') break;
+		argv[argc] = out;
+		argquoted[argc] = 0;
+		while(c < end && *c != ' ' && *c != '\t' && *c != '\r'){
+			if(*c == '\''){
+				argquoted[argc] = 1;
+				for(c++; c < end && *c != '\''; ) *out++ = *c++;
+				if(c++ == end) return -1;
+			}
+			else if(*c == '"'){
+				argquoted[argc] = 1;
+				for(c++; c < end && *c != '"'; ){
+					if(*c == '\\' && c + 1 < end && strchr("\\\"$`", c[1])) c++;
+					*out++ = *c++;
+				}
+				if(c++ == end) return -1;
+			}
+			else if(*c == '\\'){
+				argquoted[argc] = 1;
+				// a trailing \ is dropped
+				if(++c < end) *out++ = *c++;
+			}
+			else *out++ = *c++;
+		}
+		*out++ = 0;
+		argc++;
+	}
+	argv[argc] = NULL;
+	return argc;
+}
+
+/* parse token, return -2 at the end of input, -1 if failed, argc if success */
+int parseTokens(){
+	// lines read ahead don't go through the event loop, pick up the exited background jobs
+	if(inpos < inlen) handleSignals();
+	flushNotices();
+	if(interactive) printf("prompt> ");
+	atprompt = 1;
+	long len = readLine();
+	atprompt = 0;
+	if(len == -1) return -2;
+#if DEBUG_ENALBED
+	printf("input cmd: %.*s\n", (int)cmdlinelen, cmdline);
+#endif
+	return tokenize(len); // argc
+}
+
+/* Use the script of hw2 -c command or hw2 file as input, return -1 if failed */
+// a file is mapped as a whole, readLine serves every line from the mapping without a syscall
+int openScript(int nargs, char **args){
+	if(!strcmp(args[1], "-c")){
+		if(nargs < 3){
+			fprintf(stderr, "usage: %s [-c command | file]\n", args[0]);
+			laststatus = 2;
+			return -1;
+		}
+		inbuf = args[2];
+		inlen = insize = strlen(args[2]);
+	}
+	else{
+		int fd = open(args[1], O_RDONLY | O_CLOEXEC);
+		struct stat st;
+		if(fd == -1 || fstat(fd, &st) == -1){
+			perror(args[1]);
+			laststatus = 127;
+			return -1;
+		}
+		if(st.st_size){
+			inbuf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			if(inbuf == MAP_FAILED){
+				perror(args[1]);
+				laststatus = 126;
+				return -1;
+			}
+			madvise(inbuf, st.st_size, MADV_SEQUENTIAL);
+		}
+		inlen = insize = st.st_size;
+		close(fd);
+	}
+	ineof = 1;
+	return 0;
+}
+
+int main(int nargs, char **args){
+	int quit = 0;
+	if(nargs == 2 && !strcmp(args[1], "--zygote")) zygoteMain(ZYGOTE_FD);
+	bout = stdout;
+	berr = stderr;
+	if(nargs > 1 && openScript(nargs, args) == -1) return laststatus;
+	interactive = nargs == 1 && isatty(STDIN_FILENO);
+	sched_getaffinity(0, sizeof shellcpus, &shellcpus);
+	if(syscall(SYS_get_mempolicy, &shellmempolicy, &shellnodes, 64, NULL, 0) == -1){
+		shellmempolicy = MPOL_DEFAULT;
+		shellnodes = 0;
+	}
+	// job control if the shell is in the foreground of its terminal. SIGTTOU is ignored to take
+	// the terminal back while in the background
+	if(interactive && tcgetpgrp(STDIN_FILENO) == getpgrp() && tcgetattr(STDIN_FILENO, &shelltmodes) != -1){
+		ttyfd = STDIN_FILENO;
+		shellpgid = getpgrp();
+		signal(SIGTTOU, SIG_IGN);
+	}
+	initBuiltIns();
+	sessionstart = now();
+	if(initEvents() == -1){
+		perror("Failed to set up the event loop");
+		return EXIT_FAILURE;
+	}
+	do{
+		int argc = parseTokens();
+		if(argc > 0) stats.commands++;
+		if(argc == -2){ // end of input
+			// ^D is the same as quit, the background jobs of a script keep running
+			if(interactive){
+				printf("\n");
+				processBuiltInQuit(0, -1);
+			}
+			break;
+		}
+		if(argc == -1){
+			printf("Failed to parse command\n");
+			laststatus = 2;
+		}
+		else if(argc){
+			int parse_ret = parseCmd(argc);
+			switch(parse_ret){
+				case -2: printf("Failed to parse command\n"); break;
+				case -1: quit = 1; break;
+				case 0:
+					printf("Invalid command.\n");
+					laststatus = 1;
+					break;
+				default: break; // failed or pass but cmd parsed
+			}
+		}
+		// the output of the shell comes before the one of the next command
+		fflush(stdout);
+		arenaReset();
+	} while(!quit);
+	flushNotices();
+	fflush(stdout);
+	// the jobs of a script keep running in their cgroups, quit interrupted them
+	closeCgroups(quit || interactive);
+	return laststatus;
+}
+
 // #define DEBUG_ENALBED 1
 
 // #define MAX_PATH 256 // the current working directory cwd